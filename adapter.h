@@ -1,33 +1,209 @@
+#pragma once
+
 #include <iostream>
 #include <vector>
+#include <deque>
 #include <unordered_map>
 #include <functional>
 #include <unordered_set>
+#include <type_traits>
+#include <algorithm>
+#include <array>
+#include <utility>
+#include <optional>
+#include <any>
+#include <iterator>
+#include <stdexcept>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <cstring>
+#include <numeric>
+#include <span>
+#include <thread>
+#include <exception>
+#include "small_vector.h"
+#include "static_vector.h"
+#include "membership_set.h"
+#include "column_table.h"
+#include "sketches.h"
+#include "spill_run.h"
+#include "window_aggregator.h"
+#if __has_include(<sys/mman.h>)
+#include <sys/wait.h>
+#include "shared_memory.h"
+#define ADAPTERS_HAS_PROCESSES 1
+#endif
 
 template<typename Derived>
 class Adapter {
  public:
+  // Может ли адаптер обрабатывать элементы по одному, без промежуточного контейнера
+  static constexpr bool is_streaming = false;
+
+  // Тип элемента на выходе адаптера для элемента типа T на входе
+  template<typename T>
+  using output_type = T;
+
+  // Наибольшее число элементов на выходе, известное на этапе компиляции (0 - не ограничено)
+  static constexpr size_t max_output_size = 0;
+
+  // Сворачивает поток элементов в одно значение и может остановить обход досрочно
+  static constexpr bool is_terminal = false;
+
+  // Порождает поток элементов из всего входа сразу (например, слияние диапазонов)
+  static constexpr bool is_source = false;
+
+  // Каждый выходной элемент зависит только от одного входного, и на один вход
+  // приходится не больше одного выхода. Такую стадию можно применять к частям
+  // входа независимо и склеивать ответы.
+  static constexpr bool is_elementwise = false;
+
   template<typename Container>
-  auto operator()(const Container& container) const {
+  constexpr auto operator()(const Container& container) const {
 
     return static_cast<const Derived*>(this)->apply(container);
   }
+
+  // Временный вход (например, результат предыдущей стадии) передается в apply как
+  // rvalue: адаптеры, результат которых ссылается на вход, забирают его себе
+  template<typename Container, std::enable_if_t<!std::is_reference_v<Container>, int> = 0>
+  constexpr auto operator()(Container&& container) const {
+
+    return static_cast<const Derived*>(this)->apply(std::move(container));
+  }
+};
+
+template<typename T>
+struct IsStdArray : std::false_type {};
+
+template<typename T, size_t N>
+struct IsStdArray<std::array<T, N>> : std::true_type {};
+
+template<typename T>
+constexpr bool is_std_array_v = IsStdArray<std::remove_cv_t<T>>::value;
+
+// Контейнер, в котором адаптер возвращает результат для входа типа Container.
+// Для представлений, не владеющих данными, это std::vector.
+template<typename Container>
+struct OwnedContainer {
+  using type = Container;
+};
+
+template<typename Container>
+using owned_container_t = typename OwnedContainer<Container>::type;
+
+// Контейнер для ответа стадии, которая оставляет часть элементов (Filter, Take, Drop).
+// Для std::array - StaticVector той же емкости, чтобы стадия оставалась constexpr.
+template<typename Container>
+struct FilteredContainer : OwnedContainer<Container> {};
+
+template<typename T, size_t N>
+struct FilteredContainer<std::array<T, N>> {
+  using type = StaticVector<T, N>;
+};
+
+template<typename Container>
+using filtered_container_t = typename FilteredContainer<Container>::type;
+
+template<typename Container>
+constexpr auto to_owned(const Container& container) {
+  if constexpr (std::is_same_v<owned_container_t<Container>, Container>) {
+
+    return container;
+  } else {
+
+    return owned_container_t<Container>(container.begin(), container.end());
+  }
+}
+
+// Основа для терминальных адаптеров. Наследник предоставляет collector<T>(), который
+// принимает элементы по одному (false - ответ известен, дальше не читать) и
+// отдает ответ через result(). В конце цепочки коллектор получает элементы прямо
+// из потоковых стадий, без промежуточных контейнеров.
+template<typename Derived>
+class Terminal : public Adapter<Derived> {
+ public:
+  static constexpr bool is_terminal = true;
+
+  template<typename Container>
+  constexpr auto apply(const Container& container) const {
+    auto collector = static_cast<const Derived*>(this)->template collector<typename Container::value_type>();
+    for (const auto& elem : container) {
+      if (!collector(elem)) break;
+    }
+
+    return collector.result();
+  }
+};
+
+// Приемник, дописывающий элементы потока в вектор (или другой контейнер с push_back)
+template<typename T, typename Buffer = std::vector<T>>
+struct AppendTo {
+  Buffer* buffer;
+
+  constexpr bool operator()(const T& elem) const {
+    buffer->push_back(elem);
+
+    return true;
+  }
+};
+
+// Приемник, передающий элементы потока в коллектор или другой приемник по указателю
+template<typename T>
+struct ForwardTo {
+  T* target;
+
+  template<typename Elem>
+  constexpr bool operator()(const Elem& elem) const {
+
+    return (*target)(elem);
+  }
 };
 
 template<typename Func>
 class Transform : public Adapter<Transform<Func>> {
  public:
-  explicit Transform(Func func) : func(func) {}
+  static constexpr bool is_streaming = true;
+
+  static constexpr bool is_elementwise = true;
+
+  template<typename T>
+  using output_type = std::decay_t<std::invoke_result_t<const Func&, const T&>>;
+
+  constexpr explicit Transform(Func func) : func(func) {}
 
   template<typename Container>
-  auto apply(const Container& container) const {
-    Container result;
-    result.reserve(container.size());
-    for (const auto& elem : container) {
-      result.push_back(func(elem));
+  constexpr auto apply(const Container& container) const {
+    if constexpr (is_std_array_v<Container>) {
+
+      return [&]<size_t... I>(std::index_sequence<I...>) {
+        return std::array<output_type<typename Container::value_type>, sizeof...(I)>{func(container[I])...};
+      }(std::make_index_sequence<std::tuple_size_v<Container>>());
+    } else {
+      owned_container_t<Container> result;
+      result.reserve(container.size());
+      for (const auto& elem : container) {
+        result.push_back(func(elem));
+      }
+
+      return result;
     }
+  }
 
-    return result;
+  template<typename Input, typename Next>
+  constexpr auto sink(Next next) const {
+
+    return [func = func, next](const Input& elem) mutable { return next(func(elem)); };
+  }
+
+  constexpr const Func& function() const {
+
+    return func;
   }
 
  private:
@@ -37,11 +213,15 @@ class Transform : public Adapter<Transform<Func>> {
 template<typename Func>
 class Filter : public Adapter<Filter<Func>> {
  public:
-  explicit Filter(Func func) : func(func) {}
+  static constexpr bool is_streaming = true;
+
+  static constexpr bool is_elementwise = true;
+
+  constexpr explicit Filter(Func func) : func(func) {}
 
   template<typename Container>
-  auto apply(const Container& container) const {
-    Container result;
+  constexpr auto apply(const Container& container) const {
+    filtered_container_t<Container> result;
     for (const auto& elem : container) {
       if (func(elem)) {
         result.push_back(elem);
@@ -51,17 +231,30 @@ class Filter : public Adapter<Filter<Func>> {
     return result;
   }
 
+  template<typename Input, typename Next>
+  constexpr auto sink(Next next) const {
+
+    return [func = func, next](const Input& elem) mutable { return func(elem) ? next(elem) : true; };
+  }
+
+  constexpr const Func& function() const {
+
+    return func;
+  }
+
  private:
   Func func;
 };
 
 class Take : public Adapter<Take> {
  public:
-  explicit Take(size_t n) : n(n) {}
+  static constexpr bool is_streaming = true;
+
+  constexpr explicit Take(size_t n) : n(n) {}
 
   template<typename Container>
-  auto apply(const Container& container) const {
-    Container result;
+  constexpr auto apply(const Container& container) const {
+    filtered_container_t<Container> result;
     size_t count = 0;
     for (const auto& elem : container) {
       if (count++ >= n) break;
@@ -71,17 +264,36 @@ class Take : public Adapter<Take> {
     return result;
   }
 
+  // Возвращает false, когда набрано n элементов, чтобы остановить обход входа
+  template<typename Input, typename Next>
+  constexpr auto sink(Next next) const {
+
+    return [n = n, count = size_t(0), next](const Input& elem) mutable {
+      if (count >= n) return false;
+      ++count;
+
+      return next(elem) && count < n;
+    };
+  }
+
+  constexpr size_t count() const {
+
+    return n;
+  }
+
  private:
   size_t n;
 };
 
 class Drop : public Adapter<Drop> {
  public:
-  explicit Drop(size_t n) : n(n) {}
+  static constexpr bool is_streaming = true;
+
+  constexpr explicit Drop(size_t n) : n(n) {}
 
   template<typename Container>
-  auto apply(const Container& container) const {
-    Container result;
+  constexpr auto apply(const Container& container) const {
+    filtered_container_t<Container> result;
     size_t count = 0;
     for (const auto& elem : container) {
       if (count++ < n) continue;
@@ -91,6 +303,25 @@ class Drop : public Adapter<Drop> {
     return result;
   }
 
+  template<typename Input, typename Next>
+  constexpr auto sink(Next next) const {
+
+    return [n = n, count = size_t(0), next](const Input& elem) mutable {
+      if (count < n) {
+        ++count;
+
+        return true;
+      }
+
+      return next(elem);
+    };
+  }
+
+  constexpr size_t count() const {
+
+    return n;
+  }
+
  private:
   size_t n;
 };
@@ -98,13 +329,97 @@ class Drop : public Adapter<Drop> {
 class Reverse : public Adapter<Reverse> {
  public:
   template<typename Container>
-  auto apply(const Container& container) const {
-    Container result(container.rbegin(), container.rend());
+  constexpr auto apply(const Container& container) const {
+    if constexpr (is_std_array_v<Container>) {
+      constexpr size_t size = std::tuple_size_v<Container>;
 
-    return result;
+      return [&]<size_t... I>(std::index_sequence<I...>) {
+        return Container{container[size - 1 - I]...};
+      }(std::make_index_sequence<size>());
+    } else {
+      owned_container_t<Container> result(container.rbegin(), container.rend());
+
+      return result;
+    }
+  }
+};
+
+// Берет только N первых элементов, N известно на этапе компиляции.
+// Для std::array результат тоже std::array, а копирование развернуто,
+// для остальных контейнеров - SmallVector без обращений к куче.
+template<size_t N>
+class StaticTake : public Adapter<StaticTake<N>> {
+ public:
+  static constexpr bool is_streaming = true;
+
+  static constexpr size_t max_output_size = N;
+
+  template<typename Container>
+  constexpr auto apply(const Container& container) const {
+    if constexpr (is_std_array_v<Container>) {
+      constexpr size_t size = std::min(N, std::tuple_size_v<Container>);
+
+      return [&]<size_t... I>(std::index_sequence<I...>) {
+        return std::array<typename Container::value_type, size>{container[I]...};
+      }(std::make_index_sequence<size>());
+    } else {
+      SmallVector<typename Container::value_type, N> result;
+      size_t count = 0;
+      for (const auto& elem : container) {
+        if (count++ >= N) break;
+        result.push_back(elem);
+      }
+
+      return result;
+    }
+  }
+
+  template<typename Input, typename Next>
+  constexpr auto sink(Next next) const {
+
+    return Take(N).sink<Input>(next);
   }
 };
 
+template<size_t N>
+constexpr auto take() {
+
+  return StaticTake<N>();
+}
+
+// Пропускает N первых элементов, N известно на этапе компиляции
+template<size_t N>
+class StaticDrop : public Adapter<StaticDrop<N>> {
+ public:
+  static constexpr bool is_streaming = true;
+
+  template<typename Container>
+  constexpr auto apply(const Container& container) const {
+    if constexpr (is_std_array_v<Container>) {
+      constexpr size_t skipped = std::min(N, std::tuple_size_v<Container>);
+
+      return [&]<size_t... I>(std::index_sequence<I...>) {
+        return std::array<typename Container::value_type, sizeof...(I)>{container[skipped + I]...};
+      }(std::make_index_sequence<std::tuple_size_v<Container> - skipped>());
+    } else {
+
+      return Drop(N).apply(container);
+    }
+  }
+
+  template<typename Input, typename Next>
+  constexpr auto sink(Next next) const {
+
+    return Drop(N).sink<Input>(next);
+  }
+};
+
+template<size_t N>
+constexpr auto drop() {
+
+  return StaticDrop<N>();
+}
+
 class Keys : public Adapter<Keys> {
  public:
   template<typename Container>
@@ -196,193 +511,3489 @@ auto zip(const Container1& c1, const Container2& c2) {
   return Zip<Container1, Container2>(c1, c2);
 }
 
-//Делаем циклической коллекцию n раз
+// Представление пар (номер, элемент) над контейнером без копирования элементов.
+// Контейнер должен жить дольше представления.
 template<typename Container>
-class Cycle : public Adapter<Cycle<Container>> {
+class EnumerateView {
  public:
-  explicit Cycle(size_t n) : n(n) {}
+  using value_type = std::pair<size_t, typename Container::value_type>;
 
-  auto apply(const Container& container) const {
-    using ValueType = typename Container::value_type;
-    std::vector<ValueType> result;
+  class iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = EnumerateView::value_type;
+    using difference_type = std::ptrdiff_t;
+    using reference = std::pair<size_t, const typename Container::value_type&>;
 
-    for (size_t i = 0; i < n; ++i) {
-      result.insert(result.end(), container.begin(), container.end());
+    iterator() = default;
+
+    iterator(typename Container::const_iterator it, size_t index) : it(it), index(index) {}
+
+    reference operator*() const {
+
+      return reference(index, *it);
     }
 
-    return result;
-  }
+    iterator& operator++() {
+      ++it;
+      ++index;
 
- private:
-  size_t n;
-};
+      return *this;
+    }
 
-template<typename Container>
-auto cycle(size_t n) {
+    iterator operator++(int) {
+      iterator copy = *this;
+      ++*this;
 
-  return Cycle<Container>(n);
-}
+      return copy;
+    }
 
-// Максимальный элемент
-template<typename Comparator>
-class MaxElement : public Adapter<MaxElement<Comparator>> {
- public:
-  explicit MaxElement(Comparator comp) : comp(comp) {}
+    friend bool operator==(const iterator& lhs, const iterator& rhs) {
 
-  template<typename Container>
-  auto apply(const Container& container) const {
+      return lhs.it == rhs.it;
+    }
 
-    return *std::max_element(container.begin(), container.end(), comp);
-  }
+    friend bool operator!=(const iterator& lhs, const iterator& rhs) {
 
- private:
-  Comparator comp;
-};
+      return !(lhs == rhs);
+    }
 
-template<typename Comparator>
-auto max_element(Comparator comp) {
+   private:
+    typename Container::const_iterator it;
+    size_t index = 0;
+  };
 
-  return MaxElement<Comparator>(comp);
-}
+  using const_iterator = iterator;
 
-//Сортировка по некоторому признаку
-template<typename Comparator = std::less<>>
-class Sort : public Adapter<Sort<Comparator>> {
- public:
-  explicit Sort(Comparator comp = Comparator()) : comp(comp) {}
+  explicit EnumerateView(const Container& container) : container(&container) {}
 
-  template<typename Container>
-  auto apply(Container container) const {
-    std::sort(container.begin(), container.end(), comp);
+  iterator begin() const {
 
-    return container;
+    return iterator(container->begin(), 0);
   }
 
- private:
-  Comparator comp;
-};
+  iterator end() const {
 
-template<typename Comparator = std::less<>>
-auto sort(Comparator comp = Comparator()) {
+    return iterator(container->end(), container->size());
+  }
 
-  return Sort<Comparator>(comp);
-}
+  size_t size() const {
 
-//минимальный элемент
-template<typename Comparator>
-class MinElement : public Adapter<MinElement<Comparator>> {
- public:
-  explicit MinElement(Comparator comp) : comp(comp) {}
+    return container->size();
+  }
 
-  template<typename Container>
-  auto apply(const Container& container) const {
+  bool empty() const {
 
-    return *std::min_element(container.begin(), container.end(), comp);
+    return container->empty();
   }
 
  private:
-  Comparator comp;
+  const Container* container;
 };
 
-template<typename Comparator>
-auto min_element(Comparator comp) {
+//Пары (номер, элемент). Примененный к контейнеру, возвращает представление
+//без копирования; временный вход (например, ответ предыдущей стадии)
+//собирается в вектор пар. В конвейере номер добавляется к каждому элементу потока.
+class Enumerate : public Adapter<Enumerate> {
+ public:
+  static constexpr bool is_streaming = true;
 
-  return MinElement<Comparator>(comp);
-}
+  template<typename T>
+  using output_type = std::pair<size_t, T>;
 
-//Удаляет дубликаты из коллекции
-class Distinct : public Adapter<Distinct> {
- public:
   template<typename Container>
   auto apply(const Container& container) const {
-    Container result;
-    std::unordered_set<typename Container::value_type> seen;
-    for (const auto& elem : container) {
-      if (seen.insert(elem).second) {
-        result.push_back(elem);
-      }
+
+    return EnumerateView<Container>(container);
+  }
+
+  template<typename Container, std::enable_if_t<!std::is_reference_v<Container>, int> = 0>
+  auto apply(Container&& container) const {
+    std::vector<std::pair<size_t, typename Container::value_type>> result;
+    if constexpr (requires { std::size(container); }) {
+      result.reserve(std::size(container));
+    }
+    size_t index = 0;
+    for (auto& elem : container) {
+      result.emplace_back(index++, std::move(elem));
     }
 
     return result;
   }
+
+  template<typename Input, typename Next>
+  auto sink(Next next) const {
+
+    return [index = size_t(0), next](const Input& elem) mutable {
+      return next(std::pair<size_t, Input>(index++, elem));
+    };
+  }
 };
 
-auto distinct() {
+inline auto enumerate() {
 
-  return Distinct();
+  return Enumerate();
+}
+
+// Вызывает func(part, begin, end) для parts равных частей [0, n) в отдельных
+// потоках; первое исключение из потоков пробрасывается вызывающему
+template<typename Func>
+void parallel_chunks(size_t n, size_t parts, Func func) {
+  std::vector<std::exception_ptr> errors(parts);
+  std::vector<std::thread> threads;
+  threads.reserve(parts);
+  for (size_t part = 0; part < parts; ++part) {
+    threads.emplace_back([&, part]() {
+      try {
+        func(part, n * part / parts, n * (part + 1) / parts);
+      } catch (...) {
+        errors[part] = std::current_exception();
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  for (const auto& error : errors) {
+    if (error) std::rethrow_exception(error);
+  }
 }
 
-//Первый элемент в коллекции
-class First : public Adapter<First> {
+//Префиксные свертки. В конвейере накопленное значение идет вместе с потоком.
+//Примененные к контейнеру с произвольным доступом длиной от kParallelThreshold,
+//считаются в два прохода по частям: сначала параллельно сворачивается каждая
+//часть, затем, после префикса по итогам частей, каждая часть проходится
+//параллельно со своим начальным значением. Операция должна быть ассоциативной.
+template<typename Derived>
+class Scan : public Adapter<Derived> {
  public:
-  template<typename Container>
-  auto apply(const Container& container) const {
-    if (container.empty()) {
-      throw std::out_of_range("Container is empty");
-    }
+  static constexpr bool is_streaming = true;
 
-    return container.front();
+  static constexpr size_t kParallelThreshold = size_t(1) << 16;
+
+  Derived with_threads(size_t count) const {
+    Derived copy = static_cast<const Derived&>(*this);
+    copy.threads = std::max<size_t>(count, 1);
+
+    return copy;
   }
-};
 
-auto first() {
+ protected:
+  // Делить на части можно только вход с произвольным доступом
+  template<typename Container>
+  static constexpr bool is_splittable = std::random_access_iterator<typename Container::const_iterator>;
+
+  size_t parts_for(size_t size) const {
+    if (size < kParallelThreshold) return 1;
 
-  return First();
-}
+    return std::min(threads, size / (kParallelThreshold / 4));
+  }
 
-//Последний элемент в коллекции
-class Last : public Adapter<Last> {
+  size_t threads = std::max<unsigned>(std::thread::hardware_concurrency(), 1);
+};
+
+template<typename Op>
+class InclusiveScan : public Scan<InclusiveScan<Op>> {
  public:
+  explicit InclusiveScan(Op op = Op()) : op(op) {}
+
   template<typename Container>
   auto apply(const Container& container) const {
-    if (container.empty()) {
-      throw std::out_of_range("Container is empty");
+    using T = typename Container::value_type;
+    std::vector<T> result(std::size(container));
+    if constexpr (this->template is_splittable<Container>) {
+      size_t parts = this->parts_for(result.size());
+      if (parts > 1) {
+        auto first = container.begin();
+        std::vector<T> totals(parts);
+        parallel_chunks(result.size(), parts, [&](size_t part, size_t begin, size_t end) {
+          totals[part] = std::accumulate(first + begin + 1, first + end, first[begin], op);
+        });
+        std::inclusive_scan(totals.begin(), totals.end(), totals.begin(), op);
+        parallel_chunks(result.size(), parts, [&](size_t part, size_t begin, size_t end) {
+          if (part == 0) {
+            std::inclusive_scan(first + begin, first + end, result.begin() + begin, op);
+          } else {
+            std::inclusive_scan(first + begin, first + end, result.begin() + begin, op, totals[part - 1]);
+          }
+        });
+
+        return result;
+      }
     }
+    std::inclusive_scan(container.begin(), container.end(), result.begin(), op);
 
-    return container.back();
+    return result;
+  }
+
+  template<typename Input, typename Next>
+  auto sink(Next next) const {
+
+    return [op = op, acc = std::optional<Input>(), next](const Input& elem) mutable {
+      acc = acc ? Input(op(*acc, elem)) : elem;
+
+      return next(*acc);
+    };
   }
+
+ private:
+  Op op;
 };
 
-auto last() {
+template<typename Op = std::plus<>>
+auto inclusive_scan(Op op = Op()) {
 
-  return Last();
+  return InclusiveScan<Op>(op);
 }
 
-//Пересечение двух коллекций
-template<typename Container1, typename Container2>
-class Intersect : public Adapter<Intersect<Container1, Container2>> {
+//Первый элемент ответа - init, каждый следующий - свертка init со всеми
+//предыдущими элементами входа (например, смещения записей по их длинам)
+template<typename Init, typename Op>
+class ExclusiveScan : public Scan<ExclusiveScan<Init, Op>> {
  public:
-  Intersect(const Container1& c1, const Container2& c2) : c1(c1), c2(c2) {}
+  template<typename T>
+  using output_type = Init;
 
-  auto apply(const std::vector<typename Container1::value_type>&) const {
-    using ValueType = typename Container1::value_type;
-    std::unordered_set<ValueType> set1(c1.begin(), c1.end());
-    std::unordered_set<ValueType> set2(c2.begin(), c2.end());
+  ExclusiveScan(Init init, Op op = Op()) : init(init), op(op) {}
 
-    std::vector<ValueType> result;
-    for (const auto& elem : set1) {
-      if (set2.find(elem) != set2.end()) {
-        result.push_back(elem);
+  template<typename Container>
+  auto apply(const Container& container) const {
+    std::vector<Init> result(std::size(container));
+    if constexpr (this->template is_splittable<Container>) {
+      size_t parts = this->parts_for(result.size());
+      if (parts > 1) {
+        auto first = container.begin();
+        std::vector<Init> offsets(parts);
+        parallel_chunks(result.size(), parts, [&](size_t part, size_t begin, size_t end) {
+          offsets[part] = std::accumulate(first + begin + 1, first + end, Init(first[begin]), op);
+        });
+        std::exclusive_scan(offsets.begin(), offsets.end(), offsets.begin(), init, op);
+        parallel_chunks(result.size(), parts, [&](size_t part, size_t begin, size_t end) {
+          std::exclusive_scan(first + begin, first + end, result.begin() + begin, offsets[part], op);
+        });
+
+        return result;
       }
     }
+    std::exclusive_scan(container.begin(), container.end(), result.begin(), init, op);
 
     return result;
   }
 
- private:
-  const Container1& c1;
+  template<typename Input, typename Next>
+  auto sink(Next next) const {
+
+    return [op = op, acc = init, next](const Input& elem) mutable {
+      Init current = acc;
+      acc = op(acc, elem);
+
+      return next(current);
+    };
+  }
+
+ private:
+  Init init;
+  Op op;
+};
+
+template<typename Init, typename Op = std::plus<>>
+auto exclusive_scan(Init init, Op op = Op()) {
+
+  return ExclusiveScan<Init, Op>(init, op);
+}
+
+//Делаем циклической коллекцию n раз
+template<typename Container>
+class Cycle : public Adapter<Cycle<Container>> {
+ public:
+  explicit Cycle(size_t n) : n(n) {}
+
+  auto apply(const Container& container) const {
+    using ValueType = typename Container::value_type;
+    std::vector<ValueType> result;
+
+    for (size_t i = 0; i < n; ++i) {
+      result.insert(result.end(), container.begin(), container.end());
+    }
+
+    return result;
+  }
+
+ private:
+  size_t n;
+};
+
+template<typename Container>
+auto cycle(size_t n) {
+
+  return Cycle<Container>(n);
+}
+
+//Делаем циклической коллекцию N раз, N известно на этапе компиляции
+template<size_t N>
+class StaticCycle : public Adapter<StaticCycle<N>> {
+ public:
+  template<typename Container>
+  constexpr auto apply(const Container& container) const {
+    using ValueType = typename Container::value_type;
+    if constexpr (is_std_array_v<Container>) {
+      constexpr size_t size = std::tuple_size_v<Container>;
+
+      return [&]<size_t... I>(std::index_sequence<I...>) {
+        return std::array<ValueType, sizeof...(I)>{container[I % size]...};
+      }(std::make_index_sequence<size * N>());
+    } else {
+      std::vector<ValueType> result;
+      result.reserve(container.size() * N);
+      for (size_t i = 0; i < N; ++i) {
+        result.insert(result.end(), container.begin(), container.end());
+      }
+
+      return result;
+    }
+  }
+};
+
+template<size_t N>
+constexpr auto cycle() {
+
+  return StaticCycle<N>();
+}
+
+//Разбивает std::array на блоки по N элементов
+template<size_t N>
+class Chunk : public Adapter<Chunk<N>> {
+ public:
+  template<typename Container>
+  constexpr auto apply(const Container& container) const {
+    static_assert(is_std_array_v<Container>, "chunk<N>() requires std::array");
+    static_assert(N > 0, "chunk size must be positive");
+    using ValueType = typename Container::value_type;
+    constexpr size_t size = std::tuple_size_v<Container>;
+    static_assert(size % N == 0, "array size must be a multiple of the chunk size");
+
+    auto chunk_at = [&]<size_t... I>(size_t offset, std::index_sequence<I...>) {
+      return std::array<ValueType, N>{container[offset + I]...};
+    };
+
+    return [&]<size_t... C>(std::index_sequence<C...>) {
+      return std::array<std::array<ValueType, N>, size / N>{chunk_at(C * N, std::make_index_sequence<N>())...};
+    }(std::make_index_sequence<size / N>());
+  }
+};
+
+template<size_t N>
+constexpr auto chunk() {
+
+  return Chunk<N>();
+}
+
+// Максимальный элемент
+template<typename Comparator>
+class MaxElement : public Terminal<MaxElement<Comparator>> {
+ public:
+  constexpr explicit MaxElement(Comparator comp) : comp(comp) {}
+
+  template<typename Container>
+  constexpr auto apply(const Container& container) const {
+
+    return *std::max_element(container.begin(), container.end(), comp);
+  }
+
+  template<typename T>
+  constexpr auto collector() const {
+
+    return Collector<T>{comp, std::nullopt};
+  }
+
+ private:
+  template<typename T>
+  struct Collector {
+    Comparator comp;
+    std::optional<T> best;
+
+    constexpr bool operator()(const T& elem) {
+      if (!best || comp(*best, elem)) {
+        best = elem;
+      }
+
+      return true;
+    }
+
+    constexpr T result() const {
+      if (!best) {
+        throw std::out_of_range("Container is empty");
+      }
+
+      return *best;
+    }
+  };
+
+  Comparator comp;
+};
+
+template<typename Comparator>
+constexpr auto max_element(Comparator comp) {
+
+  return MaxElement<Comparator>(comp);
+}
+
+template<typename Comparator>
+class ExternalSort;
+
+template<typename Comparator>
+class AdaptiveSort;
+
+//Сортировка по некоторому признаку
+template<typename Comparator = std::less<>>
+class Sort : public Adapter<Sort<Comparator>> {
+ public:
+  constexpr explicit Sort(Comparator comp = Comparator()) : comp(comp) {}
+
+  template<typename Container>
+  constexpr auto apply(const Container& container) const {
+    auto result = to_owned(container);
+    std::sort(result.begin(), result.end(), comp);
+
+    return result;
+  }
+
+  // Записывает отсортированный вход в result, переиспользуя его память
+  template<typename Container, typename Result>
+  void run(const Container& container, Result& result) const {
+    result.clear();
+    for (const auto& elem : container) {
+      result.push_back(elem);
+    }
+    std::sort(result.begin(), result.end(), comp);
+  }
+
+  //Та же сортировка, использующая уже упорядоченные участки входа
+  AdaptiveSort<Comparator> adaptive() const {
+
+    return AdaptiveSort<Comparator>(comp);
+  }
+
+  //Та же сортировка, но в памяти держится не больше bytes байт элементов
+  ExternalSort<Comparator> with_memory_budget(size_t bytes) const {
+
+    return ExternalSort<Comparator>(comp, bytes);
+  }
+
+ private:
+  Comparator comp;
+};
+
+template<typename Comparator = std::less<>>
+constexpr auto sort(Comparator comp = Comparator()) {
+
+  return Sort<Comparator>(comp);
+}
+
+//Устойчивая сортировка естественным слиянием (powersort). Вход делится на
+//готовые серии: неубывающие берутся как есть, строго убывающие разворачиваются,
+//короткие дополняются вставками до kMinRun. Серии сливаются в порядке, который
+//задают их границы, поэтому почти упорядоченный вход сортируется за время,
+//близкое к линейному, а упорядоченный - за один проход.
+template<typename Comparator = std::less<>>
+class AdaptiveSort : public Adapter<AdaptiveSort<Comparator>> {
+ public:
+  static constexpr size_t kMinRun = 32;
+
+  explicit AdaptiveSort(Comparator comp = Comparator()) : comp(comp) {}
+
+  template<typename Container>
+  auto apply(const Container& container) const {
+    auto result = to_owned(container);
+    sort_range(result.begin(), result.end());
+
+    return result;
+  }
+
+  template<typename Iterator>
+  void sort_range(Iterator first, Iterator last) const {
+    size_t n = static_cast<size_t>(last - first);
+    if (n < 2) return;
+
+    struct Run {
+      size_t begin;
+      size_t end;
+      size_t power;
+    };
+    std::vector<Run> stack;
+    size_t begin = 0;
+    size_t end = next_run(first, 0, n);
+    while (end < n) {
+      size_t next_end = next_run(first, end, n);
+      size_t power = node_power(begin, end, next_end, n);
+      // Сливаем серии, чьи узлы лежат глубже границы между текущей и следующей
+      while (!stack.empty() && stack.back().power > power) {
+        merge_runs(first, stack.back().begin, begin, end);
+        begin = stack.back().begin;
+        stack.pop_back();
+      }
+      stack.push_back({begin, end, power});
+      begin = end;
+      end = next_end;
+    }
+    while (!stack.empty()) {
+      merge_runs(first, stack.back().begin, begin, end);
+      begin = stack.back().begin;
+      stack.pop_back();
+    }
+  }
+
+ private:
+  // Конец серии, начинающейся с begin; короткая серия дополняется вставками
+  template<typename Iterator>
+  size_t next_run(Iterator first, size_t begin, size_t n) const {
+    size_t end = begin + 1;
+    if (end == n) return end;
+
+    if (comp(first[end++], first[begin])) {
+      while (end < n && comp(first[end], first[end - 1])) {
+        ++end;
+      }
+      std::reverse(first + begin, first + end);
+    } else {
+      while (end < n && !comp(first[end], first[end - 1])) {
+        ++end;
+      }
+    }
+
+    size_t limit = std::min(n, begin + kMinRun);
+    for (; end < limit; ++end) {
+      auto position = std::upper_bound(first + begin, first + end, first[end], comp);
+      std::rotate(position, first + end, first + end + 1);
+    }
+
+    return end;
+  }
+
+  // Глубина узла между сериями [begin, mid) и [mid, end) в идеальном дереве слияний
+  static size_t node_power(size_t begin, size_t mid, size_t end, size_t n) {
+    uint64_t a = 2 * begin + (mid - begin);
+    uint64_t b = 2 * mid + (end - mid);
+    size_t power = 0;
+    while (true) {
+      ++power;
+      if (a >= n) {
+        a -= n;
+        b -= n;
+      } else if (b >= n) {
+        break;
+      }
+      a <<= 1;
+      b <<= 1;
+    }
+
+    return power;
+  }
+
+  template<typename Iterator>
+  void merge_runs(Iterator first, size_t begin, size_t mid, size_t end) const {
+    // Дописанные по порядку пакеты уже стоят на месте
+    if (!comp(first[mid], first[mid - 1])) return;
+
+    std::inplace_merge(first + begin, first + mid, first + end, comp);
+  }
+
+  Comparator comp;
+};
+
+template<typename Comparator = std::less<>>
+auto adaptive_sort(Comparator comp = Comparator()) {
+
+  return AdaptiveSort<Comparator>(comp);
+}
+
+//минимальный элемент
+template<typename Comparator>
+class MinElement : public Terminal<MinElement<Comparator>> {
+ public:
+  constexpr explicit MinElement(Comparator comp) : comp(comp) {}
+
+  template<typename Container>
+  constexpr auto apply(const Container& container) const {
+
+    return *std::min_element(container.begin(), container.end(), comp);
+  }
+
+  template<typename T>
+  constexpr auto collector() const {
+
+    return Collector<T>{comp, std::nullopt};
+  }
+
+ private:
+  template<typename T>
+  struct Collector {
+    Comparator comp;
+    std::optional<T> best;
+
+    constexpr bool operator()(const T& elem) {
+      if (!best || comp(elem, *best)) {
+        best = elem;
+      }
+
+      return true;
+    }
+
+    constexpr T result() const {
+      if (!best) {
+        throw std::out_of_range("Container is empty");
+      }
+
+      return *best;
+    }
+  };
+
+  Comparator comp;
+};
+
+template<typename Comparator>
+constexpr auto min_element(Comparator comp) {
+
+  return MinElement<Comparator>(comp);
+}
+
+//K наибольших по компаратору элементов в порядке убывания
+template<size_t K, typename Comparator = std::less<>>
+class TopK : public Terminal<TopK<K, Comparator>> {
+ public:
+  static constexpr size_t max_output_size = K;
+
+  explicit TopK(Comparator comp = Comparator()) : comp(comp) {}
+
+  template<typename T>
+  auto collector() const {
+
+    return Collector<T>{{comp}, {}};
+  }
+
+ private:
+  // Сравнение для кучи с наименьшим из отобранных элементов на вершине
+  struct HeapComparator {
+    Comparator comp;
+
+    template<typename T>
+    bool operator()(const T& lhs, const T& rhs) const {
+
+      return comp(rhs, lhs);
+    }
+  };
+
+  template<typename T>
+  struct Collector {
+    HeapComparator heap_comp;
+    SmallVector<T, K> heap;
+
+    bool operator()(const T& elem) {
+      if constexpr (K > 0) {
+        if (heap.size() < K) {
+          heap.push_back(elem);
+          std::push_heap(heap.begin(), heap.end(), heap_comp);
+        } else if (heap_comp.comp(heap.front(), elem)) {
+          std::pop_heap(heap.begin(), heap.end(), heap_comp);
+          heap.back() = elem;
+          std::push_heap(heap.begin(), heap.end(), heap_comp);
+        }
+      }
+
+      return true;
+    }
+
+    SmallVector<T, K> result() const {
+      SmallVector<T, K> sorted = heap;
+      std::sort_heap(sorted.begin(), sorted.end(), heap_comp);
+
+      return sorted;
+    }
+  };
+
+  Comparator comp;
+};
+
+template<size_t K, typename Comparator = std::less<>>
+auto top_k(Comparator comp = Comparator()) {
+
+  return TopK<K, Comparator>(comp);
+}
+
+//Удаляет дубликаты из коллекции
+class Distinct : public Adapter<Distinct> {
+ public:
+  static constexpr bool is_streaming = true;
+
+  template<typename Container>
+  auto apply(const Container& container) const {
+    owned_container_t<Container> result;
+    std::unordered_set<typename Container::value_type> seen;
+    for (const auto& elem : container) {
+      if (seen.insert(elem).second) {
+        result.push_back(elem);
+      }
+    }
+
+    return result;
+  }
+
+  // Множество уже встреченных элементов живет в приемнике и сохраняется между порциями
+  template<typename Input, typename Next>
+  auto sink(Next next) const {
+
+    return [seen = std::unordered_set<Input>(), next](const Input& elem) mutable {
+      return seen.insert(elem).second ? next(elem) : true;
+    };
+  }
+};
+
+auto distinct() {
+
+  return Distinct();
+}
+
+//Оставляет элементы, входящие (Keep = true) или не входящие в заданное множество.
+//Множество копируется в MembershipSet один раз и разделяется копиями адаптера.
+template<typename T, bool Keep>
+class FilterIn : public Adapter<FilterIn<T, Keep>> {
+ public:
+  static constexpr bool is_streaming = true;
+
+  static constexpr bool is_elementwise = true;
+
+  // Размер пакета, для которого хеши считаются и запрашиваются из памяти заранее
+  static constexpr size_t kBatchSize = 16;
+
+  template<typename Set>
+  explicit FilterIn(const Set& set) : set(std::make_shared<const MembershipSet<T>>(set)) {}
+
+  template<typename Container>
+  auto apply(const Container& container) const {
+    owned_container_t<Container> result;
+    if (set->is_dense()) {
+      for (const auto& elem : container) {
+        if (set->contains(elem) == Keep) {
+          result.push_back(elem);
+        }
+      }
+
+      return result;
+    }
+
+    uint64_t hashes[kBatchSize];
+    auto it = container.begin();
+    while (it != container.end()) {
+      auto batch_begin = it;
+      size_t count = 0;
+      for (; it != container.end() && count < kBatchSize; ++it, ++count) {
+        hashes[count] = set->hash(*it);
+        set->prefetch(hashes[count]);
+      }
+      size_t index = 0;
+      for (auto elem = batch_begin; elem != it; ++elem, ++index) {
+        if (set->contains(*elem, hashes[index]) == Keep) {
+          result.push_back(*elem);
+        }
+      }
+    }
+
+    return result;
+  }
+
+  template<typename Input, typename Next>
+  auto sink(Next next) const {
+
+    return [set = set, next](const Input& elem) mutable { return set->contains(elem) == Keep ? next(elem) : true; };
+  }
+
+  const MembershipSet<T>& membership() const {
+
+    return *set;
+  }
+
+ private:
+  std::shared_ptr<const MembershipSet<T>> set;
+};
+
+template<typename Set>
+auto filter_in(const Set& set) {
+
+  return FilterIn<typename Set::value_type, true>(set);
+}
+
+template<typename Set>
+auto filter_not_in(const Set& set) {
+
+  return FilterIn<typename Set::value_type, false>(set);
+}
+
+// Подсказка процессору загрузить строку кэша с адресом ptr
+inline void prefetch_address(const void* ptr) {
+#if defined(__GNUC__)
+  __builtin_prefetch(ptr);
+#else
+  (void)ptr;
+#endif
+}
+
+// Выдает source[i] для каждого номера i из indices, запрашивая элемент source
+// за distance номеров до обращения к нему
+template<typename Source, typename Indices, typename Push>
+void gather_into(const Source& source, const Indices& indices, size_t distance, Push push) {
+  size_t size = std::size(source);
+  auto end = std::end(indices);
+  auto ahead = std::begin(indices);
+  auto prefetch_next = [&]() {
+    size_t index = static_cast<size_t>(*ahead);
+    if (index < size) {
+      prefetch_address(&source[index]);
+    }
+    ++ahead;
+  };
+  for (size_t i = 0; i < distance && ahead != end; ++i) {
+    prefetch_next();
+  }
+  for (auto it = std::begin(indices); it != end; ++it) {
+    if (ahead != end) {
+      prefetch_next();
+    }
+    size_t index = static_cast<size_t>(*it);
+    if (index >= size) {
+      throw std::out_of_range("Gather index out of range");
+    }
+    if (!push(source[index])) return;
+  }
+}
+
+//Элементы source по номерам из входного контейнера. При случайных номерах
+//каждое обращение - промах кэша, поэтому элементы запрашиваются заранее, за
+//distance номеров вперед, и задержки памяти перекрываются.
+template<typename Source>
+class Gather : public Adapter<Gather<Source>> {
+ public:
+  static constexpr bool is_source = true;
+
+  template<typename T>
+  using output_type = typename Source::value_type;
+
+  Gather(const Source& source, size_t distance) : source(source), distance(distance) {}
+
+  template<typename Container>
+  auto apply(const Container& indices) const {
+    std::vector<typename Source::value_type> result;
+    result.reserve(std::size(indices));
+    feed(indices, AppendTo<typename Source::value_type>{&result});
+
+    return result;
+  }
+
+  template<typename Container, typename Push>
+  void feed(const Container& indices, Push push) const {
+    gather_into(source, indices, distance, push);
+  }
+
+ private:
+  const Source& source;
+  size_t distance;
+};
+
+template<typename Source>
+auto gather(const Source& source, size_t distance = 16) {
+
+  return Gather<Source>(source, distance);
+}
+
+//Переставляет элементы входа: i-й элемент ответа - container[order[i]]
+template<typename Order>
+class Permute : public Adapter<Permute<Order>> {
+ public:
+  static constexpr bool is_source = true;
+
+  Permute(const Order& order, size_t distance) : order(order), distance(distance) {}
+
+  template<typename Container>
+  auto apply(const Container& container) const {
+    std::vector<typename Container::value_type> result;
+    result.reserve(std::size(order));
+    feed(container, AppendTo<typename Container::value_type>{&result});
+
+    return result;
+  }
+
+  template<typename Container, typename Push>
+  void feed(const Container& container, Push push) const {
+    gather_into(container, order, distance, push);
+  }
+
+ private:
+  const Order& order;
+  size_t distance;
+};
+
+template<typename Order>
+auto permute(const Order& order, size_t distance = 16) {
+
+  return Permute<Order>(order, distance);
+}
+
+template<typename Map, typename = void>
+constexpr bool has_local_iterators_v = false;
+
+template<typename Map>
+constexpr bool has_local_iterators_v<Map, std::void_t<typename Map::const_local_iterator>> = true;
+
+//Поиск ключей входа в ассоциативном контейнере; для каждого ключа выдается
+//std::optional со значением. Для хеш-таблиц ключи обрабатываются пакетами:
+//сначала для всего пакета вычисляются корзины и запрашиваются их узлы, затем
+//узлы просматриваются. Промахи разных ключей пакета перекрываются.
+template<typename Map>
+class Lookup : public Adapter<Lookup<Map>> {
+ public:
+  static constexpr bool is_source = true;
+
+  template<typename T>
+  using output_type = std::optional<typename Map::mapped_type>;
+
+  static constexpr size_t kMaxBatchSize = 64;
+
+  Lookup(const Map& map, size_t batch) : map(map), batch(std::clamp<size_t>(batch, 1, kMaxBatchSize)) {}
+
+  template<typename Container>
+  auto apply(const Container& keys) const {
+    std::vector<std::optional<typename Map::mapped_type>> result;
+    result.reserve(std::size(keys));
+    feed(keys, AppendTo<std::optional<typename Map::mapped_type>>{&result});
+
+    return result;
+  }
+
+  template<typename Container, typename Push>
+  void feed(const Container& keys, Push push) const {
+    auto find = [this](const auto& key) {
+      auto found = map.find(key);
+
+      return found == map.end() ? std::nullopt : std::optional<typename Map::mapped_type>(found->second);
+    };
+    if constexpr (!has_local_iterators_v<Map>) {
+      for (const auto& key : keys) {
+        if (!push(find(key))) return;
+      }
+    } else {
+      size_t buckets[kMaxBatchSize];
+      auto it = std::begin(keys);
+      auto end = std::end(keys);
+      while (it != end) {
+        auto batch_begin = it;
+        size_t count = 0;
+        for (; it != end && count < batch; ++it, ++count) {
+          buckets[count] = map.bucket(*it);
+          auto head = map.begin(buckets[count]);
+          if (head != map.end(buckets[count])) {
+            prefetch_address(&*head);
+          }
+        }
+        size_t index = 0;
+        for (auto key = batch_begin; key != it; ++key, ++index) {
+          if (!push(probe(buckets[index], *key))) return;
+        }
+      }
+    }
+  }
+
+ private:
+  template<typename Key>
+  std::optional<typename Map::mapped_type> probe(size_t bucket, const Key& key) const {
+    for (auto node = map.begin(bucket); node != map.end(bucket); ++node) {
+      if (map.key_eq()(node->first, key)) return node->second;
+    }
+
+    return std::nullopt;
+  }
+
+  const Map& map;
+  size_t batch;
+};
+
+template<typename Map>
+auto lookup(const Map& map, size_t batch = 16) {
+
+  return Lookup<Map>(map, batch);
+}
+
+//Первый элемент в коллекции, std::nullopt для пустой
+class First : public Terminal<First> {
+ public:
+  template<typename Container>
+  constexpr auto apply(const Container& container) const {
+    using ValueType = typename Container::value_type;
+
+    return container.empty() ? std::optional<ValueType>() : std::optional<ValueType>(container.front());
+  }
+
+  template<typename T>
+  constexpr auto collector() const {
+
+    return Collector<T>();
+  }
+
+ private:
+  template<typename T>
+  struct Collector {
+    std::optional<T> value;
+
+    constexpr bool operator()(const T& elem) {
+      value = elem;
+
+      return false;
+    }
+
+    constexpr std::optional<T> result() const {
+
+      return value;
+    }
+  };
+};
+
+constexpr auto first() {
+
+  return First();
+}
+
+//Последний элемент в коллекции, std::nullopt для пустой
+class Last : public Terminal<Last> {
+ public:
+  template<typename Container>
+  constexpr auto apply(const Container& container) const {
+    using ValueType = typename Container::value_type;
+
+    return container.empty() ? std::optional<ValueType>() : std::optional<ValueType>(container.back());
+  }
+
+  template<typename T>
+  constexpr auto collector() const {
+
+    return Collector<T>();
+  }
+
+ private:
+  template<typename T>
+  struct Collector {
+    std::optional<T> value;
+
+    constexpr bool operator()(const T& elem) {
+      value = elem;
+
+      return true;
+    }
+
+    constexpr std::optional<T> result() const {
+
+      return value;
+    }
+  };
+};
+
+constexpr auto last() {
+
+  return Last();
+}
+
+//Первый элемент, удовлетворяющий предикату
+template<typename Func>
+class FindIf : public Terminal<FindIf<Func>> {
+ public:
+  constexpr explicit FindIf(Func func) : func(func) {}
+
+  template<typename T>
+  constexpr auto collector() const {
+
+    return Collector<T>{func, std::nullopt};
+  }
+
+ private:
+  template<typename T>
+  struct Collector {
+    Func func;
+    std::optional<T> value;
+
+    constexpr bool operator()(const T& elem) {
+      if (!func(elem)) return true;
+      value = elem;
+
+      return false;
+    }
+
+    constexpr std::optional<T> result() const {
+
+      return value;
+    }
+  };
+
+  Func func;
+};
+
+template<typename Func>
+constexpr auto find_if(Func func) {
+
+  return FindIf<Func>(func);
+}
+
+template<typename Func>
+constexpr auto first_where(Func func) {
+
+  return FindIf<Func>(func);
+}
+
+//Есть ли хотя бы один элемент, удовлетворяющий предикату
+template<typename Func>
+class AnyOf : public Terminal<AnyOf<Func>> {
+ public:
+  constexpr explicit AnyOf(Func func) : func(func) {}
+
+  template<typename T>
+  constexpr auto collector() const {
+
+    return Collector<T>{func, false};
+  }
+
+ private:
+  template<typename T>
+  struct Collector {
+    Func func;
+    bool found;
+
+    constexpr bool operator()(const T& elem) {
+      found = func(elem);
+
+      return !found;
+    }
+
+    constexpr bool result() const {
+
+      return found;
+    }
+  };
+
+  Func func;
+};
+
+template<typename Func>
+constexpr auto any_of(Func func) {
+
+  return AnyOf<Func>(func);
+}
+
+//Удовлетворяют ли предикату все элементы
+template<typename Func>
+class AllOf : public Terminal<AllOf<Func>> {
+ public:
+  constexpr explicit AllOf(Func func) : func(func) {}
+
+  template<typename T>
+  constexpr auto collector() const {
+
+    return Collector<T>{func, true};
+  }
+
+ private:
+  template<typename T>
+  struct Collector {
+    Func func;
+    bool all;
+
+    constexpr bool operator()(const T& elem) {
+      all = func(elem);
+
+      return all;
+    }
+
+    constexpr bool result() const {
+
+      return all;
+    }
+  };
+
+  Func func;
+};
+
+template<typename Func>
+constexpr auto all_of(Func func) {
+
+  return AllOf<Func>(func);
+}
+
+//Не удовлетворяет ли предикату ни один элемент
+template<typename Func>
+class NoneOf : public Terminal<NoneOf<Func>> {
+ public:
+  constexpr explicit NoneOf(Func func) : func(func) {}
+
+  template<typename T>
+  constexpr auto collector() const {
+
+    return Collector<T>{func, true};
+  }
+
+ private:
+  template<typename T>
+  struct Collector {
+    Func func;
+    bool none;
+
+    constexpr bool operator()(const T& elem) {
+      none = !func(elem);
+
+      return none;
+    }
+
+    constexpr bool result() const {
+
+      return none;
+    }
+  };
+
+  Func func;
+};
+
+template<typename Func>
+constexpr auto none_of(Func func) {
+
+  return NoneOf<Func>(func);
+}
+
+//Количество элементов, удовлетворяющих предикату
+template<typename Func>
+class CountIf : public Terminal<CountIf<Func>> {
+ public:
+  constexpr explicit CountIf(Func func) : func(func) {}
+
+  template<typename T>
+  constexpr auto collector() const {
+
+    return Collector<T>{func, 0};
+  }
+
+ private:
+  template<typename T>
+  struct Collector {
+    Func func;
+    size_t count;
+
+    constexpr bool operator()(const T& elem) {
+      if (func(elem)) ++count;
+
+      return true;
+    }
+
+    constexpr size_t result() const {
+
+      return count;
+    }
+  };
+
+  Func func;
+};
+
+template<typename Func>
+constexpr auto count_if(Func func) {
+
+  return CountIf<Func>(func);
+}
+
+//Число элементов для каждого значения ключа func(elem)
+template<typename Func = std::identity>
+class CountBy : public Terminal<CountBy<Func>> {
+ public:
+  explicit CountBy(Func func = Func()) : func(func) {}
+
+  template<typename T>
+  auto collector() const {
+
+    return Collector<T>{func, {}};
+  }
+
+ private:
+  template<typename T>
+  struct Collector {
+    using Key = std::decay_t<std::invoke_result_t<const Func&, const T&>>;
+
+    Func func;
+    std::unordered_map<Key, size_t> counts;
+
+    bool operator()(const T& elem) {
+      ++counts[func(elem)];
+
+      return true;
+    }
+
+    std::unordered_map<Key, size_t> result() const {
+
+      return counts;
+    }
+  };
+
+  Func func;
+};
+
+template<typename Func = std::identity>
+auto count_by(Func func = Func()) {
+
+  return CountBy<Func>(func);
+}
+
+// Равномерная выборка k элементов из потока неизвестной длины (алгоритм L).
+// Номер следующего заменяемого элемента разыгрывается заранее, поэтому случайные
+// числа тратятся только на попавшие в выборку элементы, а не на каждый.
+template<typename T>
+class Reservoir {
+ public:
+  explicit Reservoir(size_t k) : k(k) {
+    items.reserve(k);
+  }
+
+  template<typename Rng>
+  void offer(const T& elem, Rng& rng) {
+    if (k == 0) return;
+    if (items.size() < k) {
+      items.push_back(elem);
+      if (items.size() == k) {
+        weight = std::exp(std::log(unit(rng)) / k);
+        next = k + skip(rng);
+      }
+    } else if (seen == next) {
+      items[std::uniform_int_distribution<size_t>(0, k - 1)(rng)] = elem;
+      weight *= std::exp(std::log(unit(rng)) / k);
+      next = seen + 1 + skip(rng);
+    }
+    ++seen;
+  }
+
+  const std::vector<T>& sample() const {
+
+    return items;
+  }
+
+ private:
+  template<typename Rng>
+  static double unit(Rng& rng) {
+
+    return std::uniform_real_distribution<double>(std::numeric_limits<double>::min(), 1.0)(rng);
+  }
+
+  template<typename Rng>
+  size_t skip(Rng& rng) const {
+    double count = std::floor(std::log(unit(rng)) / std::log1p(-weight));
+
+    return count < 1e18 ? static_cast<size_t>(count) : static_cast<size_t>(1e18);
+  }
+
+  size_t k;
+  std::vector<T> items;
+  size_t seen = 0;
+  size_t next = 0;
+  double weight = 0;
+};
+
+//Равномерная выборка k элементов за один проход
+class SampleReservoir : public Terminal<SampleReservoir> {
+ public:
+  SampleReservoir(size_t k, uint64_t seed) : k(k), seed(seed) {}
+
+  template<typename T>
+  auto collector() const {
+
+    return Collector<T>{Reservoir<T>(k), std::mt19937_64(seed)};
+  }
+
+ private:
+  template<typename T>
+  struct Collector {
+    Reservoir<T> reservoir;
+    std::mt19937_64 rng;
+
+    bool operator()(const T& elem) {
+      reservoir.offer(elem, rng);
+
+      return true;
+    }
+
+    std::vector<T> result() const {
+
+      return reservoir.sample();
+    }
+  };
+
+  size_t k;
+  uint64_t seed;
+};
+
+inline auto sample_reservoir(size_t k, uint64_t seed) {
+
+  return SampleReservoir(k, seed);
+}
+
+//Каждый элемент попадает в выборку независимо с вероятностью p. Длина пропуска до
+//следующего выбранного элемента имеет геометрическое распределение и разыгрывается
+//один раз на выбранный элемент; в контейнерах с произвольным доступом пропуск
+//делается прыжком итератора.
+class SampleBernoulli : public Adapter<SampleBernoulli> {
+ public:
+  static constexpr bool is_streaming = true;
+
+  SampleBernoulli(double p, uint64_t seed) : p(p), seed(seed) {}
+
+  template<typename Container>
+  auto apply(const Container& container) const {
+    using Iterator = decltype(container.begin());
+    using Category = typename std::iterator_traits<Iterator>::iterator_category;
+    if constexpr (std::is_base_of_v<std::random_access_iterator_tag, Category>) {
+      owned_container_t<Container> result;
+      if (p <= 0) return result;
+      std::mt19937_64 rng(seed);
+      size_t size = container.size();
+      for (size_t index = skip(p, rng); index < size; index += 1 + skip(p, rng)) {
+        result.push_back(container.begin()[index]);
+      }
+
+      return result;
+    } else {
+      owned_container_t<Container> result;
+      auto push = sink<typename Container::value_type>([&result](const auto& elem) {
+        result.push_back(elem);
+
+        return true;
+      });
+      for (const auto& elem : container) {
+        push(elem);
+      }
+
+      return result;
+    }
+  }
+
+  template<typename Input, typename Next>
+  auto sink(Next next) const {
+    std::mt19937_64 rng(seed);
+    size_t remaining = skip(p, rng);
+
+    return [p = p, rng, remaining, next](const Input& elem) mutable {
+      if (remaining > 0) {
+        --remaining;
+
+        return true;
+      }
+      remaining = skip(p, rng);
+
+      return next(elem);
+    };
+  }
+
+ private:
+  template<typename Rng>
+  static size_t skip(double p, Rng& rng) {
+    if (p >= 1) return 0;
+    if (p <= 0) return std::numeric_limits<size_t>::max();
+
+    return std::geometric_distribution<size_t>(p)(rng);
+  }
+
+  double p;
+  uint64_t seed;
+};
+
+inline auto sample_bernoulli(double p, uint64_t seed) {
+
+  return SampleBernoulli(p, seed);
+}
+
+//Равномерная выборка до k элементов из каждой группы с одинаковым ключом.
+//Группы идут в порядке первого появления.
+template<typename KeyFunc>
+class SampleStratified : public Terminal<SampleStratified<KeyFunc>> {
+ public:
+  SampleStratified(KeyFunc key_func, size_t k, uint64_t seed) : key_func(key_func), k(k), seed(seed) {}
+
+  template<typename T>
+  auto collector() const {
+
+    return Collector<T>{key_func, k, std::mt19937_64(seed), {}, {}};
+  }
+
+ private:
+  template<typename T>
+  struct Collector {
+    using Key = std::decay_t<std::invoke_result_t<const KeyFunc&, const T&>>;
+
+    KeyFunc key_func;
+    size_t k;
+    std::mt19937_64 rng;
+    std::unordered_map<Key, size_t> strata;
+    std::vector<Reservoir<T>> reservoirs;
+
+    bool operator()(const T& elem) {
+      auto [it, inserted] = strata.try_emplace(key_func(elem), reservoirs.size());
+      if (inserted) {
+        reservoirs.emplace_back(k);
+      }
+      reservoirs[it->second].offer(elem, rng);
+
+      return true;
+    }
+
+    std::vector<T> result() const {
+      std::vector<T> sample;
+      for (const auto& reservoir : reservoirs) {
+        sample.insert(sample.end(), reservoir.sample().begin(), reservoir.sample().end());
+      }
+
+      return sample;
+    }
+  };
+
+  KeyFunc key_func;
+  size_t k;
+  uint64_t seed;
+};
+
+template<typename KeyFunc>
+auto sample_stratified(KeyFunc key_func, size_t k, uint64_t seed = 0) {
+
+  return SampleStratified<KeyFunc>(key_func, k, seed);
+}
+
+//Скетч HyperLogLog по всем элементам; скетчи частей входа объединяются через merge()
+class HllSketch : public Terminal<HllSketch> {
+ public:
+  explicit HllSketch(int precision) : precision(precision) {}
+
+  template<typename T>
+  auto collector() const {
+
+    return Collector<T>{HyperLogLog<T>(precision)};
+  }
+
+ private:
+  template<typename T>
+  struct Collector {
+    HyperLogLog<T> sketch;
+
+    bool operator()(const T& elem) {
+      sketch.add(elem);
+
+      return true;
+    }
+
+    const HyperLogLog<T>& result() const {
+
+      return sketch;
+    }
+  };
+
+  int precision;
+};
+
+inline auto hll_sketch(int precision = 12) {
+
+  return HllSketch(precision);
+}
+
+//Приближенное число различных элементов без их хранения
+class ApproxDistinctCount : public Terminal<ApproxDistinctCount> {
+ public:
+  explicit ApproxDistinctCount(int precision) : sketch(precision) {}
+
+  template<typename T>
+  auto collector() const {
+
+    return Collector<decltype(sketch.template collector<T>())>{sketch.template collector<T>()};
+  }
+
+ private:
+  template<typename SketchCollector>
+  struct Collector {
+    SketchCollector sketch;
+
+    template<typename T>
+    bool operator()(const T& elem) {
+
+      return sketch(elem);
+    }
+
+    size_t result() const {
+
+      return static_cast<size_t>(std::llround(sketch.result().estimate()));
+    }
+  };
+
+  HllSketch sketch;
+};
+
+inline auto approx_distinct_count(int precision = 12) {
+
+  return ApproxDistinctCount(precision);
+}
+
+//Скетч квантилей KLL по всем элементам; скетчи частей входа объединяются через merge()
+template<typename Comparator = std::less<>>
+class KllSketchBuilder : public Terminal<KllSketchBuilder<Comparator>> {
+ public:
+  KllSketchBuilder(size_t k, Comparator comp) : k(k), comp(comp) {}
+
+  template<typename T>
+  auto collector() const {
+
+    return Collector<T>{KllSketch<T, Comparator>(k, comp)};
+  }
+
+ private:
+  template<typename T>
+  struct Collector {
+    KllSketch<T, Comparator> sketch;
+
+    bool operator()(const T& elem) {
+      sketch.add(elem);
+
+      return true;
+    }
+
+    const KllSketch<T, Comparator>& result() const {
+
+      return sketch;
+    }
+  };
+
+  size_t k;
+  Comparator comp;
+};
+
+template<typename Comparator = std::less<>>
+auto kll_sketch(size_t k = 200, Comparator comp = Comparator()) {
+
+  return KllSketchBuilder<Comparator>(k, comp);
+}
+
+//Приближенные квантили (доли из [0, 1]) за один проход и O(k log n) памяти
+template<typename Comparator = std::less<>>
+class ApproxQuantiles : public Terminal<ApproxQuantiles<Comparator>> {
+ public:
+  ApproxQuantiles(std::vector<double> qs, size_t k, Comparator comp) : qs(std::move(qs)), sketch(k, comp) {}
+
+  template<typename T>
+  auto collector() const {
+
+    return Collector<decltype(sketch.template collector<T>())>{sketch.template collector<T>(), qs};
+  }
+
+ private:
+  template<typename SketchCollector>
+  struct Collector {
+    SketchCollector sketch;
+    std::vector<double> qs;
+
+    template<typename T>
+    bool operator()(const T& elem) {
+
+      return sketch(elem);
+    }
+
+    auto result() const {
+
+      return sketch.result().quantiles(qs);
+    }
+  };
+
+  std::vector<double> qs;
+  KllSketchBuilder<Comparator> sketch;
+};
+
+template<typename Comparator = std::less<>>
+auto approx_quantiles(std::vector<double> qs, size_t k = 200, Comparator comp = Comparator()) {
+
+  return ApproxQuantiles<Comparator>(std::move(qs), k, comp);
+}
+
+//Пересечение двух коллекций
+template<typename Container1, typename Container2>
+class Intersect : public Adapter<Intersect<Container1, Container2>> {
+ public:
+  Intersect(const Container1& c1, const Container2& c2) : c1(c1), c2(c2) {}
+
+  auto apply(const std::vector<typename Container1::value_type>&) const {
+    using ValueType = typename Container1::value_type;
+    std::unordered_set<ValueType> set1(c1.begin(), c1.end());
+    std::unordered_set<ValueType> set2(c2.begin(), c2.end());
+
+    std::vector<ValueType> result;
+    for (const auto& elem : set1) {
+      if (set2.find(elem) != set2.end()) {
+        result.push_back(elem);
+      }
+    }
+
+    return result;
+  }
+
+ private:
+  const Container1& c1;
   const Container2& c2;
 };
 
-template<typename Container1, typename Container2>
-auto intersect(const Container1& c1, const Container2& c2) {
+template<typename Container1, typename Container2>
+auto intersect(const Container1& c1, const Container2& c2) {
+
+  return Intersect<Container1, Container2>(c1, c2);
+}
+
+//Слияние отсортированных диапазонов через дерево проигравших.
+//Вход - контейнер отсортированных контейнеров, каждый элемент сравнивается
+//O(log k) раз. При равенстве первым идет элемент из диапазона с меньшим номером.
+template<typename Comparator = std::less<>>
+class Merge : public Adapter<Merge<Comparator>> {
+ public:
+  static constexpr bool is_source = true;
+
+  template<typename Range>
+  using output_type = typename Range::value_type;
+
+  explicit Merge(Comparator comp = Comparator()) : comp(comp) {}
+
+  template<typename Container>
+  auto apply(const Container& container) const {
+    std::vector<output_type<typename Container::value_type>> result;
+    size_t total = 0;
+    for (const auto& range : container) {
+      total += range.size();
+    }
+    result.reserve(total);
+    feed(container, [&result](const auto& elem) {
+      result.push_back(elem);
+
+      return true;
+    });
+
+    return result;
+  }
+
+  // Выдает элементы по одному, пока push возвращает true
+  template<typename Container, typename Push>
+  void feed(const Container& container, Push push) const {
+    using Iterator = decltype(std::begin(*std::begin(container)));
+    std::vector<std::pair<Iterator, Iterator>> cursors;
+    for (const auto& range : container) {
+      cursors.emplace_back(std::begin(range), std::end(range));
+    }
+    size_t k = cursors.size();
+    if (k == 0) return;
+
+    // Побеждает меньший элемент, непустой диапазон побеждает пустой
+    auto beats = [&](size_t lhs, size_t rhs) {
+      if (cursors[rhs].first == cursors[rhs].second) return true;
+      if (cursors[lhs].first == cursors[lhs].second) return false;
+      if (comp(*cursors[lhs].first, *cursors[rhs].first)) return true;
+
+      return !comp(*cursors[rhs].first, *cursors[lhs].first) && lhs < rhs;
+    };
+
+    // Листья занимают позиции k..2k-1, во внутренних узлах хранятся проигравшие
+    std::vector<size_t> losers(k);
+    std::vector<size_t> winners(2 * k);
+    for (size_t i = 0; i < k; ++i) {
+      winners[k + i] = i;
+    }
+    for (size_t node = k - 1; node >= 1; --node) {
+      size_t lhs = winners[2 * node];
+      size_t rhs = winners[2 * node + 1];
+      bool left_wins = beats(lhs, rhs);
+      winners[node] = left_wins ? lhs : rhs;
+      losers[node] = left_wins ? rhs : lhs;
+    }
+    size_t winner = k == 1 ? 0 : winners[1];
+
+    while (cursors[winner].first != cursors[winner].second) {
+      if (!push(*cursors[winner].first)) return;
+      ++cursors[winner].first;
+      for (size_t node = (winner + k) / 2; node >= 1; node /= 2) {
+        if (beats(losers[node], winner)) {
+          std::swap(losers[node], winner);
+        }
+      }
+    }
+  }
+
+ private:
+  Comparator comp;
+};
+
+template<typename Comparator = std::less<>>
+auto merge(Comparator comp = Comparator()) {
+
+  return Merge<Comparator>(comp);
+}
+
+//Внешняя сортировка. Вход читается серией за серией по budget байт, каждая
+//серия сортируется и сбрасывается во временный файл, затем серии сливаются
+//деревом проигравших. Если весь вход уместился в одну серию, диск не трогается.
+//Одновременно сливается не больше kMaxFanIn серий: как только в конце списка
+//накапливается kMaxFanIn серий одного уровня, они сливаются в одну серию
+//следующего уровня, поэтому число открытых файлов растет как логарифм входа.
+//Является источником, поэтому в конвейере результат выдается по одному элементу.
+template<typename Comparator = std::less<>>
+class ExternalSort : public Adapter<ExternalSort<Comparator>> {
+ public:
+  static constexpr bool is_source = true;
+
+  static constexpr size_t kMaxFanIn = 32;
+
+  // Наименьший блок чтения серии; при малом бюджете буферы чтения
+  // могут в сумме превысить его на kMaxFanIn таких блоков
+  static constexpr size_t kMinBlockBytes = 4096;
+
+  ExternalSort(Comparator comp, size_t budget) : comp(comp), budget(budget) {}
+
+  template<typename Container>
+  auto apply(const Container& container) const {
+    std::vector<typename Container::value_type> result;
+    feed(container, [&result](const auto& elem) {
+      result.push_back(elem);
+
+      return true;
+    });
+
+    return result;
+  }
+
+  // Выдает элементы по возрастанию, пока push возвращает true
+  template<typename Container, typename Push>
+  void feed(const Container& container, Push push) const {
+    using T = typename Container::value_type;
+    static_assert(std::is_trivially_copyable_v<T>, "External sort requires trivially copyable elements");
+    size_t run_size = std::max<size_t>(budget / sizeof(T), 1);
+
+    std::vector<T> buffer;
+    if constexpr (requires { std::size(container); }) {
+      buffer.reserve(std::min<size_t>(run_size, std::size(container)));
+    } else {
+      buffer.reserve(run_size);
+    }
+    std::vector<SpillRun<T>> runs;
+    std::vector<size_t> levels;
+    auto spill = [&]() {
+      std::sort(buffer.begin(), buffer.end(), comp);
+      runs.emplace_back(buffer);
+      levels.push_back(0);
+      buffer.clear();
+      // Группа kMaxFanIn серий одного уровня в конце списка сливается в одну
+      while (runs.size() >= kMaxFanIn && levels[levels.size() - kMaxFanIn] == levels.back()) {
+        size_t level = levels.back() + 1;
+        merge_tail(runs, kMaxFanIn, run_size);
+        levels.resize(runs.size());
+        levels.back() = level;
+      }
+    };
+    for (const auto& elem : container) {
+      buffer.push_back(elem);
+      if (buffer.size() == run_size) {
+        spill();
+      }
+    }
+
+    if (runs.empty()) {
+      std::sort(buffer.begin(), buffer.end(), comp);
+      for (const auto& elem : buffer) {
+        if (!push(elem)) return;
+      }
+
+      return;
+    }
+    if (!buffer.empty()) {
+      spill();
+    }
+    std::vector<T>().swap(buffer);
+
+    while (runs.size() > kMaxFanIn) {
+      merge_tail(runs, kMaxFanIn, run_size);
+    }
+    rewind_all(runs.begin(), runs.end(), run_size);
+    Merge<Comparator>(comp).feed(runs, push);
+  }
+
+ private:
+  // Бюджет делится между буферами чтения серий, но не меньше kMinBlockBytes на серию
+  template<typename Iterator>
+  static void rewind_all(Iterator first, Iterator last, size_t run_size) {
+    using T = typename std::iterator_traits<Iterator>::value_type::value_type;
+    size_t count = static_cast<size_t>(last - first);
+    size_t block = std::max(run_size / count, std::max<size_t>(kMinBlockBytes / sizeof(T), 1));
+    for (; first != last; ++first) {
+      first->rewind(block);
+    }
+  }
+
+  // Заменяет последние count серий одной, полученной их слиянием
+  template<typename T>
+  void merge_tail(std::vector<SpillRun<T>>& runs, size_t count, size_t run_size) const {
+    auto group_begin = runs.end() - count;
+    rewind_all(group_begin, runs.end(), run_size);
+
+    SpillRun<T> merged;
+    std::vector<T> out;
+    size_t block = std::max(run_size / (count + 1), std::max<size_t>(kMinBlockBytes / sizeof(T), 1));
+    out.reserve(block);
+    Merge<Comparator>(comp).feed(std::span<const SpillRun<T>>(&*group_begin, count), [&](const T& elem) {
+      out.push_back(elem);
+      if (out.size() == block) {
+        merged.write(out.data(), out.size());
+        out.clear();
+      }
+
+      return true;
+    });
+    merged.write(out.data(), out.size());
+
+    runs.erase(group_begin, runs.end());
+    runs.push_back(std::move(merged));
+  }
+
+  Comparator comp;
+  size_t budget;
+};
+
+//Делит текст на поля по символу delim. Поля - std::string_view в исходный буфер,
+//поэтому текст должен жить дольше результата. Пустые поля сохраняются: n
+//разделителей дают n + 1 поле. Разделитель ищется через memchr.
+class Split : public Adapter<Split> {
+ public:
+  static constexpr bool is_source = true;
+
+  template<typename T>
+  using output_type = std::string_view;
+
+  explicit Split(char delim) : delim(delim) {}
+
+  template<typename Container>
+  auto apply(const Container& text) const {
+    std::vector<std::string_view> result;
+    feed(text, [&result](std::string_view token) {
+      result.push_back(token);
+
+      return true;
+    });
+
+    return result;
+  }
+
+  // Выдает поля по одному, пока push возвращает true
+  template<typename Container, typename Push>
+  void feed(const Container& text, Push push) const {
+    const char* pos = std::data(text);
+    const char* end = pos + std::size(text);
+    while (true) {
+      const char* found = pos == end ? nullptr : static_cast<const char*>(std::memchr(pos, delim, end - pos));
+      if (found == nullptr) {
+        push(std::string_view(pos, end - pos));
+
+        return;
+      }
+      if (!push(std::string_view(pos, found - pos))) return;
+      pos = found + 1;
+    }
+  }
+
+ private:
+  char delim;
+};
+
+inline auto split(char delim) {
+
+  return Split(delim);
+}
+
+//Делит текст на слова по любому из символов chars; пустые слова пропускаются.
+//Символы-разделители хранятся таблицей из 256 бит, для одного символа
+//поиск идет через memchr.
+class SplitAny : public Adapter<SplitAny> {
+ public:
+  static constexpr bool is_source = true;
+
+  template<typename T>
+  using output_type = std::string_view;
+
+  explicit SplitAny(std::string_view chars) : single(chars.size() == 1 ? chars[0] : '\0'), use_memchr(chars.size() == 1) {
+    for (unsigned char c : chars) {
+      table[c / 64] |= uint64_t(1) << (c % 64);
+    }
+  }
+
+  template<typename Container>
+  auto apply(const Container& text) const {
+    std::vector<std::string_view> result;
+    feed(text, [&result](std::string_view token) {
+      result.push_back(token);
+
+      return true;
+    });
+
+    return result;
+  }
+
+  template<typename Container, typename Push>
+  void feed(const Container& text, Push push) const {
+    const char* pos = std::data(text);
+    const char* end = pos + std::size(text);
+    while (pos != end) {
+      const char* found = find(pos, end);
+      if (found != pos && !push(std::string_view(pos, found - pos))) return;
+      if (found == end) return;
+      pos = found + 1;
+    }
+  }
+
+ private:
+  bool is_delim(unsigned char c) const {
+
+    return (table[c / 64] >> (c % 64)) & 1;
+  }
+
+  const char* find(const char* pos, const char* end) const {
+    if (use_memchr) {
+      const void* found = std::memchr(pos, single, end - pos);
+
+      return found == nullptr ? end : static_cast<const char*>(found);
+    }
+    while (pos != end && !is_delim(static_cast<unsigned char>(*pos))) {
+      ++pos;
+    }
+
+    return pos;
+  }
+
+  uint64_t table[4] = {0, 0, 0, 0};
+  char single;
+  bool use_memchr;
+};
+
+inline auto split_any(std::string_view chars) {
+
+  return SplitAny(chars);
+}
+
+//Строки текста без символов перевода строки ("\n" или "\r\n").
+//Перевод строки в конце текста не порождает пустой последней строки.
+class Lines : public Adapter<Lines> {
+ public:
+  static constexpr bool is_source = true;
+
+  template<typename T>
+  using output_type = std::string_view;
+
+  template<typename Container>
+  auto apply(const Container& text) const {
+    std::vector<std::string_view> result;
+    feed(text, [&result](std::string_view line) {
+      result.push_back(line);
+
+      return true;
+    });
+
+    return result;
+  }
+
+  template<typename Container, typename Push>
+  void feed(const Container& text, Push push) const {
+    const char* end = std::data(text) + std::size(text);
+    Split('\n').feed(text, [&](std::string_view line) {
+      // Пустой хвост после завершающего перевода строки - не строка
+      if (line.data() == end) return true;
+      if (!line.empty() && line.back() == '\r') {
+        line.remove_suffix(1);
+      }
+
+      return push(line);
+    });
+  }
+};
+
+inline auto lines() {
+
+  return Lines();
+}
+
+//Отрезает символы chars с обоих концов каждой строки. Строки std::string (например,
+//ответ Transform) могут быть временными, поэтому для них результат - std::string;
+//для остальных строк - string_view в тот же буфер, что и входная строка.
+//Примененный к тексту целиком, возвращает один string_view, а для временного
+//текста - std::string.
+class Trim : public Adapter<Trim> {
+ public:
+  static constexpr bool is_streaming = true;
+
+  static constexpr bool is_elementwise = true;
+
+  template<typename T>
+  using output_type = std::conditional_t<std::is_same_v<std::remove_cv_t<T>, std::string>, std::string, std::string_view>;
+
+  explicit Trim(std::string_view chars = " \t\r\n\f\v") : chars(chars.begin(), chars.end()) {}
+
+  template<typename Container>
+  auto apply(const Container& container) const {
+    if constexpr (std::is_convertible_v<const Container&, std::string_view>) {
+
+      return trim(container);
+    } else {
+      std::vector<output_type<typename Container::value_type>> result;
+      result.reserve(container.size());
+      for (const auto& elem : container) {
+        result.emplace_back(trim(elem));
+      }
+
+      return result;
+    }
+  }
+
+  template<typename Container, std::enable_if_t<!std::is_reference_v<Container>, int> = 0>
+  auto apply(Container&& container) const {
+    if constexpr (std::is_convertible_v<const Container&, std::string_view>) {
+
+      return std::string(trim(container));
+    } else {
+
+      return apply(static_cast<const Container&>(container));
+    }
+  }
+
+  template<typename Input, typename Next>
+  auto sink(Next next) const {
+
+    return [trim = *this, next](const Input& elem) mutable { return next(output_type<Input>(trim.trim(elem))); };
+  }
+
+  std::string_view trim(std::string_view text) const {
+    size_t first = text.find_first_not_of(chars);
+    if (first == std::string_view::npos) return text.substr(text.size());
+
+    return text.substr(first, text.find_last_not_of(chars) - first + 1);
+  }
+
+ private:
+  std::string chars;
+};
+
+inline auto trim(std::string_view chars = " \t\r\n\f\v") {
+
+  return Trim(chars);
+}
+
+// Метка времени как число тактов: арифметические метки используются как есть,
+// у std::chrono::duration и std::chrono::time_point берется число тактов
+template<typename Timestamp>
+struct TimestampTicks {
+  using type = Timestamp;
+
+  static type count(Timestamp ts) {
+
+    return ts;
+  }
+
+  static Timestamp from(type ticks) {
+
+    return ticks;
+  }
+
+  template<typename Duration>
+  static type length(Duration duration) {
+
+    return static_cast<type>(duration);
+  }
+};
+
+template<typename Rep, typename Period>
+struct TimestampTicks<std::chrono::duration<Rep, Period>> {
+  using Timestamp = std::chrono::duration<Rep, Period>;
+  using type = Rep;
+
+  static type count(Timestamp ts) {
+
+    return ts.count();
+  }
+
+  static Timestamp from(type ticks) {
+
+    return Timestamp(ticks);
+  }
+
+  template<typename Duration>
+  static type length(Duration duration) {
+
+    return std::chrono::duration_cast<Timestamp>(duration).count();
+  }
+};
+
+template<typename Clock, typename ClockDuration>
+struct TimestampTicks<std::chrono::time_point<Clock, ClockDuration>> {
+  using Timestamp = std::chrono::time_point<Clock, ClockDuration>;
+  using type = typename ClockDuration::rep;
+
+  static type count(Timestamp ts) {
+
+    return ts.time_since_epoch().count();
+  }
+
+  static Timestamp from(type ticks) {
+
+    return Timestamp(ClockDuration(ticks));
+  }
+
+  template<typename Duration>
+  static type length(Duration duration) {
+
+    return std::chrono::duration_cast<ClockDuration>(duration).count();
+  }
+};
+
+//Агрегаты (число, сумма, минимум, максимум) по временным окнам [start, start + width),
+//начала которых кратны step. Метку времени элемента дает ts_func, значение -
+//value_func. Метки - числа, std::chrono::duration или std::chrono::time_point;
+//для меток std::chrono ширина и шаг - std::chrono::duration. Вход должен быть
+//упорядочен по времени. Выдаются только непустые окна. Каждый элемент добавляется
+//в окно и удаляется из него один раз, поэтому шаг окна не зависит от его ширины.
+template<typename TsFunc, typename Duration, typename ValueFunc>
+class TimeWindow : public Adapter<TimeWindow<TsFunc, Duration, ValueFunc>> {
+ public:
+  static constexpr bool is_source = true;
+
+  template<typename T>
+  using timestamp_type = std::decay_t<std::invoke_result_t<const TsFunc&, const T&>>;
+
+  template<typename T>
+  using output_type = WindowStats<timestamp_type<T>, std::decay_t<std::invoke_result_t<const ValueFunc&, const T&>>>;
+
+  TimeWindow(TsFunc ts_func, Duration width, Duration step, ValueFunc value_func)
+      : ts_func(ts_func), value_func(value_func), width(width), step(step) {
+    if (!(width > Duration()) || !(step > Duration())) {
+      throw std::invalid_argument("Window width and step must be positive");
+    }
+  }
+
+  template<typename Container>
+  auto apply(const Container& container) const {
+    std::vector<output_type<typename Container::value_type>> result;
+    feed(container, [&result](const auto& window) {
+      result.push_back(window);
+
+      return true;
+    });
+
+    return result;
+  }
+
+  // Выдает окна по возрастанию начала, пока push возвращает true
+  template<typename Container, typename Push>
+  void feed(const Container& container, Push push) const {
+    using T = typename Container::value_type;
+    using Timestamp = timestamp_type<T>;
+    using Stats = output_type<T>;
+    using Ticks = TimestampTicks<Timestamp>;
+    using Tick = typename Ticks::type;
+    Tick width_ticks = Ticks::length(width);
+    Tick step_ticks = Ticks::length(step);
+    if (!(width_ticks > Tick()) || !(step_ticks > Tick())) {
+      throw std::invalid_argument("Window width and step must be positive");
+    }
+
+    WindowAggregator<Tick, decltype(Stats::sum)> window;
+    Tick start{};
+    bool started = false;
+    Tick previous{};
+
+    auto emit = [&]() {
+      return push(Stats{Ticks::from(start), Ticks::from(start + width_ticks), window.count(), window.sum(),
+                        window.min(), window.max()});
+    };
+
+    for (const auto& elem : container) {
+      Tick ts = Ticks::count(ts_func(elem));
+      if (started && ts < previous) {
+        throw std::invalid_argument("Window input must be ordered by timestamp");
+      }
+      previous = ts;
+      if (!started || window.empty()) {
+        Tick first = first_start(ts, width_ticks, step_ticks);
+        start = started ? std::max(start, first) : first;
+        started = true;
+      }
+      while (!(ts < start + width_ticks)) {
+        if (!window.empty() && !emit()) return;
+        start += step_ticks;
+        window.evict_before(start);
+        if (window.empty()) {
+          start = std::max(start, first_start(ts, width_ticks, step_ticks));
+        }
+      }
+      // При step > width между окнами есть промежутки
+      if (ts < start) continue;
+      window.push(ts, value_func(elem));
+    }
+
+    while (!window.empty()) {
+      if (!emit()) return;
+      start += step_ticks;
+      window.evict_before(start);
+    }
+  }
+
+ private:
+  // Начало первого окна, которое может содержать ts. Для беззнаковых меток
+  // окна не начинаются раньше нуля, и ts - width не вычисляется при ts < width.
+  template<typename Tick>
+  static Tick first_start(Tick ts, Tick width, Tick step) {
+    if constexpr (std::is_unsigned_v<Tick>) {
+      if (ts < width) return Tick();
+    }
+
+    return align_down(ts - width, step) + step;
+  }
+
+  // Наибольшее кратное step, не превосходящее ts
+  template<typename Timestamp>
+  static Timestamp align_down(Timestamp ts, Timestamp step) {
+    if constexpr (std::is_integral_v<Timestamp>) {
+      Timestamp quotient = ts / step;
+      if (ts % step != 0 && ts < 0) --quotient;
+
+      return quotient * step;
+    } else {
+
+      return std::floor(ts / step) * step;
+    }
+  }
+
+  TsFunc ts_func;
+  ValueFunc value_func;
+  Duration width;
+  Duration step;
+};
+
+template<typename TsFunc, typename Duration, typename ValueFunc = std::identity>
+auto tumbling_window(TsFunc ts_func, Duration width, ValueFunc value_func = ValueFunc()) {
+
+  return TimeWindow<TsFunc, Duration, ValueFunc>(ts_func, width, width, value_func);
+}
+
+template<typename TsFunc, typename Duration, typename ValueFunc = std::identity>
+auto sliding_window_by_time(TsFunc ts_func, Duration width, Duration step, ValueFunc value_func = ValueFunc()) {
+
+  return TimeWindow<TsFunc, Duration, ValueFunc>(ts_func, width, step, value_func);
+}
+
+enum class SetOperation {
+  kUnion,
+  kDifference,
+  kSymmetricDifference,
+};
+
+//Теоретико-множественные операции входа с другой коллекцией. Кратные элементы
+//учитываются как в std::set_union и подобных. Если обе коллекции отсортированы,
+//используется слияние за один проход с сохранением порядка, иначе - подсчет
+//вхождений в хеш-таблице, и элементы идут в порядке первого появления.
+template<typename Container, typename Comparator, SetOperation Operation>
+class SetAlgebra : public Adapter<SetAlgebra<Container, Comparator, Operation>> {
+ public:
+  SetAlgebra(const Container& other, Comparator comp) : other(other), comp(comp) {}
+
+  template<typename Input>
+  auto apply(const Input& input) const {
+    using ValueType = typename Input::value_type;
+    std::vector<ValueType> result;
+    if (std::is_sorted(input.begin(), input.end(), comp) && std::is_sorted(other.begin(), other.end(), comp)) {
+      auto out = std::back_inserter(result);
+      if constexpr (Operation == SetOperation::kUnion) {
+        std::set_union(input.begin(), input.end(), other.begin(), other.end(), out, comp);
+      } else if constexpr (Operation == SetOperation::kDifference) {
+        std::set_difference(input.begin(), input.end(), other.begin(), other.end(), out, comp);
+      } else {
+        std::set_symmetric_difference(input.begin(), input.end(), other.begin(), other.end(), out, comp);
+      }
+
+      return result;
+    }
+
+    // Сколько вхождений каждого элемента other еще не нашли пары во входе
+    std::unordered_map<ValueType, size_t> unmatched;
+    for (const auto& elem : other) {
+      ++unmatched[elem];
+    }
+    for (const auto& elem : input) {
+      auto it = unmatched.find(elem);
+      bool matched = it != unmatched.end() && it->second > 0;
+      if (matched) {
+        --it->second;
+      }
+      if (!matched || Operation == SetOperation::kUnion) {
+        result.push_back(elem);
+      }
+    }
+    if constexpr (Operation != SetOperation::kDifference) {
+      for (const auto& elem : other) {
+        auto it = unmatched.find(elem);
+        if (it->second > 0) {
+          --it->second;
+          result.push_back(elem);
+        }
+      }
+    }
+
+    return result;
+  }
+
+ private:
+  const Container& other;
+  Comparator comp;
+};
+
+template<typename Container, typename Comparator = std::less<>>
+auto set_union(const Container& other, Comparator comp = Comparator()) {
+
+  return SetAlgebra<Container, Comparator, SetOperation::kUnion>(other, comp);
+}
+
+template<typename Container, typename Comparator = std::less<>>
+auto set_difference(const Container& other, Comparator comp = Comparator()) {
+
+  return SetAlgebra<Container, Comparator, SetOperation::kDifference>(other, comp);
+}
+
+template<typename Container, typename Comparator = std::less<>>
+auto symmetric_difference(const Container& other, Comparator comp = Comparator()) {
+
+  return SetAlgebra<Container, Comparator, SetOperation::kSymmetricDifference>(other, comp);
+}
+
+template<typename... Columns>
+TableView<Columns...> as_view(const ColumnTable<Columns...>& table) {
+
+  return table.view();
+}
+
+template<typename... Columns>
+const TableView<Columns...>& as_view(const TableView<Columns...>& view) {
+
+  return view;
+}
+
+//Фильтрация строк таблицы по значению одного столбца. Читается только этот
+//столбец, результат - выборка с вектором номеров строк.
+template<size_t I, typename Func>
+class Where : public Adapter<Where<I, Func>> {
+ public:
+  explicit Where(Func func) : func(func) {}
+
+  template<typename Source>
+  auto apply(const Source& source) const {
+    const auto& view = as_view(source);
+    const auto& column = view.table().template column<I>();
+    std::vector<size_t> selection;
+    for (size_t i = 0; i < view.size(); ++i) {
+      size_t row = view.row_index(i);
+      if (func(column[row])) {
+        selection.push_back(row);
+      }
+    }
+
+    return std::decay_t<decltype(view)>(view.table(), std::move(selection));
+  }
+
+ private:
+  Func func;
+};
+
+template<size_t I, typename Func>
+auto where(Func func) {
+
+  return Where<I, Func>(func);
+}
+
+//Упорядочивание строк таблицы по одному столбцу; переставляются только номера строк
+template<size_t I, typename Comparator = std::less<>>
+class OrderBy : public Adapter<OrderBy<I, Comparator>> {
+ public:
+  explicit OrderBy(Comparator comp = Comparator()) : comp(comp) {}
+
+  template<typename Source>
+  auto apply(const Source& source) const {
+    const auto& view = as_view(source);
+    const auto& column = view.table().template column<I>();
+    std::vector<size_t> selection = view.selection();
+    std::stable_sort(selection.begin(), selection.end(), [&](size_t lhs, size_t rhs) {
+      return comp(column[lhs], column[rhs]);
+    });
+
+    return std::decay_t<decltype(view)>(view.table(), std::move(selection));
+  }
+
+ private:
+  Comparator comp;
+};
+
+template<size_t I, typename Comparator = std::less<>>
+auto order_by(Comparator comp = Comparator()) {
+
+  return OrderBy<I, Comparator>(comp);
+}
+
+//Значения одного столбца для выбранных строк; дальше работают обычные адаптеры
+template<size_t I>
+class Column : public Adapter<Column<I>> {
+ public:
+  template<typename Source>
+  auto apply(const Source& source) const {
+    const auto& view = as_view(source);
+    const auto& column = view.table().template column<I>();
+    std::vector<typename std::decay_t<decltype(column)>::value_type> result;
+    result.reserve(view.size());
+    for (size_t i = 0; i < view.size(); ++i) {
+      result.push_back(column[view.row_index(i)]);
+    }
+
+    return result;
+  }
+};
+
+template<size_t I>
+auto column() {
+
+  return Column<I>();
+}
+
+//Сборка выбранных строк таблицы в кортежи (поздняя материализация)
+class Rows : public Adapter<Rows> {
+ public:
+  template<typename Source>
+  auto apply(const Source& source) const {
+    const auto& view = as_view(source);
+    std::vector<typename std::decay_t<decltype(view.table())>::row_type> result;
+    result.reserve(view.size());
+    for (size_t i = 0; i < view.size(); ++i) {
+      result.push_back(view.table().row(view.row_index(i)));
+    }
+
+    return result;
+  }
+};
+
+inline auto rows() {
+
+  return Rows();
+}
+
+template<typename T>
+constexpr bool is_adapter_v = std::is_base_of_v<Adapter<T>, T>;
+
+// Прогоняет вход через потоковую стадию или стадию-источник, передавая элементы в push
+template<typename Stage, typename Container, typename Push>
+constexpr void stream_into(const Stage& stage, const Container& container, Push push) {
+  if constexpr (Stage::is_source) {
+    stage.feed(container, push);
+  } else {
+    auto sink = stage.template sink<typename Container::value_type>(push);
+    for (const auto& elem : container) {
+      if (!sink(elem)) break;
+    }
+  }
+}
+
+// Записывает ответ стадии в output, переиспользуя его память. Стадия может
+// предоставить собственный run(container, output); потоковая стадия дописывает
+// элементы по одному, остальные копируют свой ответ.
+template<typename Stage, typename Container, typename Output>
+void run_stage(const Stage& stage, const Container& container, Output& output) {
+  if constexpr (requires { stage.run(container, output); }) {
+    stage.run(container, output);
+  } else if constexpr (Stage::is_streaming || Stage::is_source) {
+    output.clear();
+    stream_into(stage, container, AppendTo<typename Output::value_type, Output>{&output});
+  } else {
+    output.clear();
+    for (const auto& elem : stage(container)) {
+      output.push_back(elem);
+    }
+  }
+}
+
+// Результат потоковой цепочки: исходный контейнер, если тип элемента не изменился, иначе вектор
+template<typename Container, typename T>
+using PipelineResult = std::conditional_t<std::is_same_v<typename Container::value_type, T>,
+                                          owned_container_t<Container>, std::vector<T>>;
+
+// Результат потоковой цепочки, вычисляемый по мере обхода и запоминаемый в буфере.
+// Частичный обход вычисляет только нужный префикс, повторные обходы читают буфер.
+// Копии представления разделяют один буфер. Вход, переданный по ссылке, должен
+// жить дольше представления; временный вход представление забирает себе.
+// Буфер - дек: дописывание не перемещает вычисленные элементы, поэтому ссылки
+// на них остаются действительными, пока жив буфер.
+template<typename Container, typename Stage>
+class CachedView {
+ public:
+  using value_type = typename Stage::template output_type<typename Container::value_type>;
+
+  class iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = CachedView::value_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const value_type*;
+    using reference = const value_type&;
+
+    iterator() : view(nullptr), index(kEnd) {}
+
+    iterator(const CachedView* view, size_t index) : view(view), index(index) {}
+
+    reference operator*() const {
+      view->ensure(index);
+
+      return view->state->buffer[index];
+    }
+
+    pointer operator->() const {
+
+      return &**this;
+    }
+
+    iterator& operator++() {
+      ++index;
+
+      return *this;
+    }
+
+    iterator operator++(int) {
+      iterator copy = *this;
+      ++index;
+
+      return copy;
+    }
+
+    // Конец определяется лениво: итератор достиг конца, если элемент с его номером не удалось вычислить
+    friend bool operator==(const iterator& lhs, const iterator& rhs) {
+      if (lhs.index != kEnd && rhs.index != kEnd) return lhs.index == rhs.index;
+
+      return lhs.at_end() == rhs.at_end();
+    }
+
+    friend bool operator!=(const iterator& lhs, const iterator& rhs) {
+
+      return !(lhs == rhs);
+    }
+
+   private:
+    static constexpr size_t kEnd = static_cast<size_t>(-1);
+
+    bool at_end() const {
+
+      return index == kEnd || !view->ensure(index);
+    }
+
+    const CachedView* view;
+    size_t index;
+  };
+
+  using const_iterator = iterator;
+
+  CachedView(const Container& source, const Stage& stage) : state(std::make_shared<State>(source, stage)) {}
+
+  CachedView(Container&& source, const Stage& stage) : state(std::make_shared<State>(std::move(source), stage)) {}
+
+  iterator begin() const {
+
+    return iterator(this, 0);
+  }
+
+  iterator end() const {
+
+    return iterator();
+  }
+
+  auto rbegin() const {
+    fill();
+
+    return state->buffer.crbegin();
+  }
+
+  auto rend() const {
+    fill();
+
+    return state->buffer.crend();
+  }
+
+  size_t size() const {
+    fill();
+
+    return state->buffer.size();
+  }
+
+  bool empty() const {
+
+    return !ensure(0);
+  }
+
+  const value_type& front() const {
+    ensure(0);
+
+    return state->buffer.front();
+  }
+
+  const value_type& back() const {
+    fill();
+
+    return state->buffer.back();
+  }
+
+  const value_type& operator[](size_t index) const {
+    ensure(index);
+
+    return state->buffer[index];
+  }
+
+  // Сколько элементов уже вычислено
+  size_t cached_size() const {
+
+    return state->buffer.size();
+  }
+
+  bool is_complete() const {
+
+    return state->done;
+  }
+
+ private:
+  using Iterator = decltype(std::declval<const Container&>().begin());
+
+  using Buffer = std::deque<value_type>;
+
+  struct State {
+    State(const Container& source, const Stage& stage)
+        : source(source), position(source.begin()), stage(stage), sink(make_sink(this->stage, buffer)) {}
+
+    State(Container&& source, const Stage& stage)
+        : owned(std::move(source)), source(*owned), position(this->source.begin()), stage(stage),
+          sink(make_sink(this->stage, buffer)) {}
+
+    State(const State&) = delete;
+    State& operator=(const State&) = delete;
+
+    static auto make_sink(const Stage& stage, Buffer& buffer) {
+      if constexpr (Stage::is_source) {
+
+        return 0;
+      } else {
+
+        return stage.template sink<typename Container::value_type>(AppendTo<value_type, Buffer>{&buffer});
+      }
+    }
+
+    std::optional<Container> owned;
+    const Container& source;
+    Iterator position;
+    Stage stage;
+    Buffer buffer;
+    decltype(make_sink(std::declval<const Stage&>(), std::declval<Buffer&>())) sink;
+    bool done = false;
+  };
+
+  // Вычисляет элементы, пока их не станет больше index; false, если вход кончился раньше
+  bool ensure(size_t index) const {
+    State& s = *state;
+    if constexpr (Stage::is_source) {
+      fill();
+    } else {
+      while (s.buffer.size() <= index && !s.done) {
+        if (s.position == s.source.end() || !s.sink(*s.position)) {
+          s.done = true;
+        } else {
+          ++s.position;
+        }
+      }
+    }
+
+    return index < s.buffer.size();
+  }
+
+  void fill() const {
+    State& s = *state;
+    if constexpr (Stage::is_source) {
+      if (!s.done) {
+        s.stage.feed(s.source, AppendTo<value_type, Buffer>{&s.buffer});
+        s.done = true;
+      }
+    } else {
+      while (!s.done) {
+        ensure(s.buffer.size());
+      }
+    }
+  }
+
+  std::shared_ptr<State> state;
+};
+
+template<typename Container, typename Stage>
+struct OwnedContainer<CachedView<Container, Stage>> {
+  using type = std::vector<typename CachedView<Container, Stage>::value_type>;
+};
 
-  return Intersect<Container1, Container2>(c1, c2);
+//Запоминание результата цепочки. В конце составной цепочки из потоковых стадий
+//возвращает CachedView, который вычисляет элементы при первом обходе и хранит их.
+//Примененный к готовому контейнеру, просто возвращает его копию.
+class Cache : public Adapter<Cache> {
+ public:
+  template<typename Container>
+  auto apply(const Container& container) const {
+
+    return to_owned(container);
+  }
+};
+
+inline auto cache() {
+
+  return Cache();
+}
+
+// Композиция двух адаптеров, не привязанная к данным. Может храниться, копироваться
+// и применяться к любому количеству контейнеров. Если обе части потоковые (или
+// первая - источник), вход обходится за один проход без промежуточных контейнеров.
+template<typename First, typename Second>
+class Pipeline : public Adapter<Pipeline<First, Second>> {
+ public:
+  static constexpr bool is_streaming = First::is_streaming && Second::is_streaming;
+
+  static constexpr bool is_source = First::is_source && Second::is_streaming;
+
+  static constexpr bool is_single_pass = is_streaming || is_source;
+
+  // Терминальная стадия в конце потоковой цепочки сама служит терминальной стадией
+  static constexpr bool is_terminal = Second::is_terminal && First::is_streaming;
+
+  static constexpr bool is_elementwise = First::is_elementwise && Second::is_elementwise;
+
+  template<typename T>
+  using output_of_first = typename First::template output_type<T>;
+
+  template<typename T>
+  using output_type = typename Second::template output_type<output_of_first<T>>;
+
+  // Потоковые стадии не увеличивают число элементов, поэтому ограничение сохраняется
+  static constexpr size_t max_output_size =
+      Second::max_output_size > 0 ? Second::max_output_size : (Second::is_streaming ? First::max_output_size : 0);
+
+  constexpr Pipeline(First first, Second second) : first_stage(first), second_stage(second) {}
+
+  template<typename Container>
+  constexpr auto apply(const Container& container) const {
+    if constexpr (std::is_same_v<Second, Cache> && (First::is_streaming || First::is_source)) {
+
+      return CachedView<Container, First>(container, first_stage);
+    } else if constexpr (Second::is_terminal && (First::is_streaming || First::is_source)) {
+      // Терминальная стадия читает элементы прямо из потока и может прервать обход
+      using ValueType = typename First::template output_type<typename Container::value_type>;
+      auto collector = second_stage.template collector<ValueType>();
+      stream_into(first_stage, container, [&collector](const auto& elem) { return collector(elem); });
+
+      return collector.result();
+    } else if constexpr (is_single_pass && !is_std_array_v<Container>) {
+      using ValueType = output_type<typename Container::value_type>;
+      std::conditional_t<(max_output_size > 0), SmallVector<ValueType, max_output_size>,
+                         PipelineResult<Container, ValueType>> result;
+      run(container, result);
+
+      return result;
+    } else {
+
+      return second_stage(first_stage(container));
+    }
+  }
+
+  // Временный вход (например, ответ непотоковой стадии перед цепочкой) CachedView
+  // забирает себе, иначе он бы ссылался на уничтоженный контейнер
+  template<typename Container, std::enable_if_t<!std::is_reference_v<Container>, int> = 0>
+  constexpr auto apply(Container&& container) const {
+    if constexpr (std::is_same_v<Second, Cache> && (First::is_streaming || First::is_source)) {
+
+      using Owned = std::remove_const_t<Container>;
+
+      return CachedView<Owned, First>(Owned(std::move(container)), first_stage);
+    } else {
+
+      return apply(static_cast<const Container&>(container));
+    }
+  }
+
+  // Применяет цепочку, записывая ответ в result. Память result переиспользуется
+  // между запусками. Однопроходная цепочка (is_single_pass) других буферов не
+  // имеет. В остальных цепочках ответ первой части хранится в буфере самой
+  // цепочки, который тоже переиспользуется, поэтому при обработке потока пакетов
+  // выделений почти нет. Из-за этого буфера один объект цепочки нельзя запускать
+  // из нескольких потоков одновременно; копии цепочки независимы.
+  template<typename Container, typename Result>
+  constexpr void run(const Container& container, Result& result) const {
+    if constexpr (is_single_pass) {
+      result.clear();
+      feed(container, AppendTo<typename Result::value_type, Result>{&result});
+    } else {
+      auto& middle = scratch_buffer<std::vector<output_of_first<typename Container::value_type>>>();
+      run_stage(first_stage, container, middle);
+      run_stage(second_stage, middle, result);
+    }
+  }
+
+  template<typename Input, typename Next>
+  constexpr auto sink(Next next) const {
+
+    return first_stage.template sink<Input>(second_stage.template sink<output_of_first<Input>>(next));
+  }
+
+  template<typename Container, typename Push>
+  constexpr void feed(const Container& container, Push push) const {
+    using ValueType = output_of_first<typename Container::value_type>;
+    stream_into(first_stage, container, second_stage.template sink<ValueType>(push));
+  }
+
+  // Коллектор терминальной цепочки: элементы проходят через приемник первой части
+  // в коллектор второй. Коллектор хранит ссылку на себя, поэтому не копируется.
+  template<typename T>
+  constexpr auto collector() const {
+    static_assert(is_terminal, "Only a streaming chain ending in a terminal stage has a collector");
+
+    return Collector<T>(first_stage, second_stage);
+  }
+
+  constexpr const First& first() const {
+
+    return first_stage;
+  }
+
+  constexpr const Second& second() const {
+
+    return second_stage;
+  }
+
+ private:
+  template<typename T>
+  struct Collector {
+    using Inner = decltype(std::declval<const Second&>().template collector<output_of_first<T>>());
+    using Sink = decltype(std::declval<const First&>().template sink<T>(std::declval<ForwardTo<Inner>>()));
+
+    constexpr Collector(const First& first, const Second& second)
+        : inner(second.template collector<output_of_first<T>>()), sink(first.template sink<T>(ForwardTo<Inner>{&inner})) {}
+
+    Collector(const Collector&) = delete;
+    Collector& operator=(const Collector&) = delete;
+
+    constexpr bool operator()(const T& elem) {
+
+      return sink(elem);
+    }
+
+    constexpr decltype(auto) result() {
+
+      return inner.result();
+    }
+
+    Inner inner;
+    Sink sink;
+  };
+
+  struct NoScratch {};
+
+  template<typename Buffer>
+  Buffer& scratch_buffer() const {
+    if (auto* buffer = std::any_cast<Buffer>(&scratch)) return *buffer;
+
+    return scratch.template emplace<Buffer>();
+  }
+
+  First first_stage;
+  Second second_stage;
+  // Ответ первой части для run(); тип зависит от входа, поэтому хранится в std::any
+  [[no_unique_address]] mutable std::conditional_t<is_single_pass, NoScratch, std::any> scratch;
+};
+
+template<typename T>
+struct IsPipeline : std::false_type {};
+
+template<typename First, typename Second>
+struct IsPipeline<Pipeline<First, Second>> : std::true_type {};
+
+//Пропускает элементы без изменений
+class PassThrough : public Adapter<PassThrough> {
+ public:
+  static constexpr bool is_streaming = true;
+
+  static constexpr bool is_elementwise = true;
+
+  template<typename Container>
+  constexpr auto apply(const Container& container) const {
+
+    return to_owned(container);
+  }
+
+  template<typename Input, typename Next>
+  constexpr auto sink(Next next) const {
+
+    return next;
+  }
+};
+
+//Собирает поток в вектор; терминальная стадия для цепочек без собственной
+class Collect : public Terminal<Collect> {
+ public:
+  template<typename T>
+  auto collector() const {
+
+    return Collector<T>();
+  }
+
+ private:
+  template<typename T>
+  struct Collector {
+    std::vector<T> items;
+
+    bool operator()(const T& elem) {
+      items.push_back(elem);
+
+      return true;
+    }
+
+    const std::vector<T>& result() const {
+
+      return items;
+    }
+  };
+};
+
+// Разбиение цепочки на потоковую часть и терминальную стадию
+template<typename Stage>
+auto incremental_head(const Stage& stage) {
+  if constexpr (!Stage::is_terminal) {
+
+    return stage;
+  } else if constexpr (IsPipeline<Stage>::value) {
+
+    return stage.first();
+  } else {
+
+    return PassThrough();
+  }
+}
+
+template<typename Stage>
+auto incremental_tail(const Stage& stage) {
+  if constexpr (!Stage::is_terminal) {
+
+    return Collect();
+  } else if constexpr (IsPipeline<Stage>::value) {
+
+    return stage.second();
+  } else {
+
+    return stage;
+  }
+}
+
+// Результат цепочки, который обновляется при дописывании элементов в конец источника.
+// refresh() прогоняет через стадии только новые элементы; состояние стадий (Take,
+// Drop, distinct(), min/max, count_if, top_k) сохраняется между обновлениями.
+// Источник должен жить дольше представления и только расти.
+template<typename Container, typename Stage>
+class IncrementalView {
+ public:
+  using Input = typename Container::value_type;
+  using Head = decltype(incremental_head(std::declval<const Stage&>()));
+  using Tail = decltype(incremental_tail(std::declval<const Stage&>()));
+
+  static_assert(Head::is_streaming, "incremental() needs streaming stages, optionally followed by a terminal one");
+
+  IncrementalView(const Container& source, const Stage& stage)
+      : source(&source), consumed_(0), state(std::make_unique<State>(stage)) {}
+
+  // Прогоняет через стадии элементы, дописанные после прошлого обновления
+  void update() {
+    if (source->size() < consumed_) {
+      throw std::logic_error("Source of an incremental pipeline must only grow");
+    }
+    for (auto it = source->begin() + consumed_; it != source->end() && !state->done; ++it) {
+      state->done = !state->sink(*it);
+    }
+    consumed_ = source->size();
+  }
+
+  decltype(auto) refresh() {
+    update();
+
+    return result();
+  }
+
+  decltype(auto) result() const {
+
+    return state->collector.result();
+  }
+
+  // Сколько элементов источника уже обработано
+  size_t consumed() const {
+
+    return consumed_;
+  }
+
+ private:
+  using HeadOutput = typename Head::template output_type<Input>;
+  using Collector = decltype(std::declval<const Tail&>().template collector<HeadOutput>());
+  using Sink = decltype(std::declval<const Head&>().template sink<Input>(std::declval<ForwardTo<Collector>>()));
+
+  struct State {
+    explicit State(const Stage& stage)
+        : head(incremental_head(stage)),
+          collector(incremental_tail(stage).template collector<HeadOutput>()),
+          sink(head.template sink<Input>(ForwardTo<Collector>{&collector})) {}
+
+    Head head;
+    Collector collector;
+    Sink sink;
+    bool done = false;
+  };
+
+  const Container* source;
+  size_t consumed_;
+  std::unique_ptr<State> state;
+};
+
+//Превращает цепочку в инкрементально обновляемый результат над растущим источником
+template<typename Stage>
+class Incremental : public Adapter<Incremental<Stage>> {
+ public:
+  explicit Incremental(Stage stage) : stage(stage) {}
+
+  template<typename Container>
+  auto apply(const Container& container) const {
+    IncrementalView<Container, Stage> view(container, stage);
+    view.update();
+
+    return view;
+  }
+
+ private:
+  Stage stage;
+};
+
+template<typename Stage>
+auto incremental(Stage stage) {
+
+  return Incremental<Stage>(stage);
+}
+
+#ifdef ADAPTERS_HAS_PROCESSES
+//Выполняет поэлементную цепочку (Filter, Transform и т.п.) в workers дочерних
+//процессах. Вход копируется в сегмент разделяемой памяти и делится на равные
+//части; каждый процесс, созданный fork, пишет ответы своей части в тот же
+//сегмент, откуда родитель собирает их по порядку. Функторы цепочки не
+//вызываются из нескольких потоков одного процесса, поэтому подходят и для
+//непотокобезопасного кода. Элементы входа и выхода копируются байтово.
+template<typename Stage>
+class InProcesses : public Adapter<InProcesses<Stage>> {
+ public:
+  static_assert(Stage::is_elementwise, "Only element-wise stages can be split across processes");
+
+  InProcesses(Stage stage, size_t workers) : stage(stage), workers(std::max<size_t>(workers, 1)) {}
+
+  template<typename Container>
+  auto apply(const Container& container) const {
+    using T = typename Container::value_type;
+    using Output = typename Stage::template output_type<T>;
+    static_assert(std::is_trivially_copyable_v<T>, "Input elements must be trivially copyable");
+    static_assert(std::is_trivially_copyable_v<Output>, "Output elements must be trivially copyable");
+
+    size_t n = std::distance(std::begin(container), std::end(container));
+    size_t parts = std::min(workers, n);
+    std::vector<Output> result;
+    if (parts == 0) return result;
+
+    // Вход, выход (не длиннее входа) и число ответов каждой части
+    size_t output_offset = align(n * sizeof(T));
+    size_t counts_offset = align(output_offset + n * sizeof(Output));
+    SharedSegment segment(counts_offset + parts * sizeof(size_t));
+    T* input = reinterpret_cast<T*>(segment.data());
+    Output* output = reinterpret_cast<Output*>(segment.data() + output_offset);
+    size_t* counts = reinterpret_cast<size_t*>(segment.data() + counts_offset);
+    std::copy(std::begin(container), std::end(container), input);
+
+    std::vector<pid_t> children;
+    for (size_t part = 0; part < parts; ++part) {
+      size_t begin = n * part / parts;
+      size_t end = n * (part + 1) / parts;
+      pid_t pid = fork();
+      if (pid == 0) {
+        int status = 0;
+        try {
+          size_t count = 0;
+          Output* out = output + begin;
+          stream_into(stage, std::span<const T>(input + begin, end - begin), [&](const Output& elem) {
+            ::new (static_cast<void*>(out + count++)) Output(elem);
+
+            return true;
+          });
+          counts[part] = count;
+        } catch (...) {
+          status = 1;
+        }
+        _exit(status);
+      }
+      if (pid < 0) break;
+      children.push_back(pid);
+    }
+
+    bool failed = children.size() != parts;
+    for (pid_t pid : children) {
+      int status = 0;
+      if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        failed = true;
+      }
+    }
+    if (failed) {
+      throw std::runtime_error("Worker process failed");
+    }
+
+    size_t total = 0;
+    for (size_t part = 0; part < parts; ++part) {
+      total += counts[part];
+    }
+    result.reserve(total);
+    for (size_t part = 0; part < parts; ++part) {
+      Output* out = output + n * part / parts;
+      result.insert(result.end(), out, out + counts[part]);
+    }
+
+    return result;
+  }
+
+ private:
+  static size_t align(size_t offset) {
+
+    return (offset + 63) / 64 * 64;
+  }
+
+  Stage stage;
+  size_t workers;
+};
+
+template<typename Stage>
+auto in_processes(Stage stage, size_t workers) {
+
+  return InProcesses<Stage>(stage, workers);
+}
+#endif
+
+// Слияние соседних стадий при построении цепочки
+template<typename F, typename G>
+constexpr auto fuse(const Filter<F>& lhs, const Filter<G>& rhs) {
+  auto predicate = [f = lhs.function(), g = rhs.function()](const auto& elem) { return f(elem) && g(elem); };
+
+  return Filter<decltype(predicate)>(predicate);
+}
+
+template<typename F, typename G>
+constexpr auto fuse(const Transform<F>& lhs, const Transform<G>& rhs) {
+  auto func = [f = lhs.function(), g = rhs.function()](const auto& elem) { return g(f(elem)); };
+
+  return Transform<decltype(func)>(func);
+}
+
+constexpr auto fuse(const Take& lhs, const Take& rhs) {
+
+  return Take(std::min(lhs.count(), rhs.count()));
+}
+
+constexpr auto fuse(const Drop& lhs, const Drop& rhs) {
+
+  return Drop(lhs.count() + rhs.count());
+}
+
+template<typename L, typename R, typename = void>
+constexpr bool can_fuse_v = false;
+
+template<typename L, typename R>
+constexpr bool can_fuse_v<L, R, std::void_t<decltype(fuse(std::declval<const L&>(), std::declval<const R&>()))>> = true;
+
+template<typename L, typename R>
+constexpr auto compose(const L& lhs, const R& rhs) {
+  if constexpr (can_fuse_v<L, R>) {
+
+    return fuse(lhs, rhs);
+  } else {
+
+    return Pipeline<L, R>(lhs, rhs);
+  }
 }
 
+template<typename A, typename B, typename R>
+constexpr auto compose(const Pipeline<A, B>& lhs, const R& rhs) {
+  if constexpr (can_fuse_v<B, R>) {
+
+    return compose(lhs.first(), fuse(lhs.second(), rhs));
+  } else {
+
+    return Pipeline<Pipeline<A, B>, R>(lhs, rhs);
+  }
+}
+
+// Результат одной потоковой стадии (или стадии-источника), примененной к контейнеру.
+// Вычисляется при первом обращении к элементам и запоминается; до этого следующая
+// терминальная или потоковая стадия присоединяется к цепочке над исходным входом,
+// поэтому v | Filter(f) | first() читает вход только до первого подходящего
+// элемента. Вход должен жить и не меняться, пока результат не вычислен.
+template<typename Container, typename Stage>
+class LazyResult {
+ public:
+  using result_type = decltype(std::declval<const Stage&>()(std::declval<const Container&>()));
+  using value_type = typename result_type::value_type;
+  using iterator = decltype(std::declval<const result_type&>().begin());
+  using const_iterator = iterator;
+
+  LazyResult(const Container& source, const Stage& stage) : source(&source), stage(stage) {}
+
+  const result_type& value() const& {
+    if (!result) {
+      result.emplace(stage(*source));
+    }
+
+    return *result;
+  }
+
+  result_type value() && {
+    value();
+
+    return std::move(*result);
+  }
+
+  operator const result_type&() const& {
+
+    return value();
+  }
+
+  // Следующая стадия, присоединенная к этой над исходным входом
+  template<typename Next>
+  auto then(const Next& next) const {
+    auto chain = compose(stage, next);
+    if constexpr (Next::is_terminal || std::is_same_v<Next, Cache>) {
+
+      return chain(*source);
+    } else {
+
+      return LazyResult<Container, decltype(chain)>(*source, chain);
+    }
+  }
+
+  iterator begin() const {
+
+    return value().begin();
+  }
+
+  iterator end() const {
+
+    return value().end();
+  }
+
+  auto rbegin() const {
+
+    return value().rbegin();
+  }
+
+  auto rend() const {
+
+    return value().rend();
+  }
+
+  size_t size() const {
+
+    return value().size();
+  }
+
+  bool empty() const {
+
+    return value().empty();
+  }
+
+  decltype(auto) front() const {
+
+    return value().front();
+  }
+
+  decltype(auto) back() const {
+
+    return value().back();
+  }
+
+  decltype(auto) operator[](size_t index) const {
+
+    return value()[index];
+  }
+
+  template<typename Other>
+  friend bool operator==(const LazyResult& lhs, const Other& rhs) {
+
+    return lhs.value() == rhs;
+  }
+
+ private:
+  const Container* source;
+  Stage stage;
+  mutable std::optional<result_type> result;
+};
+
+template<typename Container, typename Stage>
+struct OwnedContainer<LazyResult<Container, Stage>> {
+  using type = owned_container_t<typename LazyResult<Container, Stage>::result_type>;
+};
+
+template<typename T>
+struct IsLazyResult : std::false_type {};
+
+template<typename Container, typename Stage>
+struct IsLazyResult<LazyResult<Container, Stage>> : std::true_type {};
+
+template<typename T>
+constexpr bool is_lazy_result_v = IsLazyResult<std::remove_cvref_t<T>>::value;
+
+// Откладывается одиночная потоковая стадия над именованным контейнером; массивы
+// std::array вычисляются сразу, чтобы цепочки над ними оставались constexpr
+template<typename Container, typename Stage>
+constexpr bool defers_v = std::is_lvalue_reference_v<Container> && (Stage::is_streaming || Stage::is_source)
+    && !IsPipeline<Stage>::value && !is_std_array_v<std::remove_cvref_t<Container>>;
+
 // Оператор для цепочки адаптеров
-template<typename Container, typename Adapter>
-auto operator|(const Container& container, const Adapter& adapter) {
+template<typename Container, typename Adapter,
+         std::enable_if_t<!is_adapter_v<std::remove_cvref_t<Container>> && !is_lazy_result_v<Container>, int> = 0>
+constexpr auto operator|(Container&& container, const Adapter& adapter) {
+  if constexpr (defers_v<Container, Adapter>) {
+
+    return LazyResult<std::remove_cvref_t<Container>, Adapter>(container, adapter);
+  } else {
+
+    return adapter(std::forward<Container>(container));
+  }
+}
+
+// Продолжение отложенного результата: терминальные, потоковые стадии и cache()
+// присоединяются к цепочке, остальные получают вычисленный результат
+template<typename Result, typename Adapter, std::enable_if_t<is_lazy_result_v<Result>, int> = 0>
+auto operator|(Result&& lazy, const Adapter& adapter) {
+  if constexpr (Adapter::is_terminal || Adapter::is_streaming || std::is_same_v<Adapter, Cache>) {
+
+    return lazy.then(adapter);
+  } else {
+
+    return adapter(std::forward<Result>(lazy).value());
+  }
+}
+
+// Оператор для построения цепочки из адаптеров без данных
+template<typename L, typename R, std::enable_if_t<is_adapter_v<L> && is_adapter_v<R>, int> = 0>
+constexpr auto operator|(const L& lhs, const R& rhs) {
 
-  return adapter(container);
+  return compose(lhs, rhs);
 }
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstddef>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+template<typename... Columns>
+class TableView;
+
+// Таблица, хранящая каждый столбец в отдельном непрерывном векторе.
+// Адаптеры над таблицей читают только те столбцы, с которыми работают.
+template<typename... Columns>
+class ColumnTable {
+  static_assert(sizeof...(Columns) > 0, "ColumnTable needs at least one column");
+
+ public:
+  using row_type = std::tuple<Columns...>;
+
+  ColumnTable() = default;
+
+  explicit ColumnTable(std::vector<Columns>... columns) : columns(std::move(columns)...) {
+    size_t rows = size();
+    bool same_length = std::apply([rows](const auto&... column) { return ((column.size() == rows) && ...); }, this->columns);
+    if (!same_length) {
+      throw std::invalid_argument("ColumnTable columns must have equal lengths");
+    }
+  }
+
+  void push_back(const Columns&... values) {
+    push_back_impl(std::index_sequence_for<Columns...>(), values...);
+  }
+
+  void reserve(size_t capacity) {
+    std::apply([capacity](auto&... column) { (column.reserve(capacity), ...); }, columns);
+  }
+
+  size_t size() const {
+
+    return std::get<0>(columns).size();
+  }
+
+  bool empty() const {
+
+    return size() == 0;
+  }
+
+  template<size_t I>
+  const auto& column() const {
+
+    return std::get<I>(columns);
+  }
+
+  template<size_t I>
+  auto& column() {
+
+    return std::get<I>(columns);
+  }
+
+  row_type row(size_t index) const {
+
+    return std::apply([index](const auto&... column) { return row_type(column[index]...); }, columns);
+  }
+
+  TableView<Columns...> view() const {
+
+    return TableView<Columns...>(*this);
+  }
+
+ private:
+  template<size_t... I>
+  void push_back_impl(std::index_sequence<I...>, const Columns&... values) {
+    (std::get<I>(columns).push_back(values), ...);
+  }
+
+  std::tuple<std::vector<Columns>...> columns;
+};
+
+// Выборка строк таблицы: ссылка на таблицу и вектор номеров выбранных строк.
+// Пока фильтров не было, вектор не строится и выбраны все строки.
+template<typename... Columns>
+class TableView {
+ public:
+  using Table = ColumnTable<Columns...>;
+
+  explicit TableView(const Table& table) : table_(&table), all_rows(true) {}
+
+  TableView(const Table& table, std::vector<size_t> selection)
+      : table_(&table), all_rows(false), selection_(std::move(selection)) {}
+
+  const Table& table() const {
+
+    return *table_;
+  }
+
+  size_t size() const {
+
+    return all_rows ? table_->size() : selection_.size();
+  }
+
+  bool empty() const {
+
+    return size() == 0;
+  }
+
+  // Номер строки таблицы для i-й строки выборки
+  size_t row_index(size_t i) const {
+
+    return all_rows ? i : selection_[i];
+  }
+
+  // Номера выбранных строк; для полной выборки строятся по запросу
+  std::vector<size_t> selection() const {
+    if (!all_rows) {
+
+      return selection_;
+    }
+    std::vector<size_t> result(table_->size());
+    for (size_t i = 0; i < result.size(); ++i) {
+      result[i] = i;
+    }
+
+    return result;
+  }
+
+ private:
+  const Table* table_;
+  bool all_rows;
+  std::vector<size_t> selection_;
+};
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+
+// Перемешивание битов хеша (финализатор splitmix64). std::hash для целых чисел
+// в libstdc++ тождественный, а фильтрам Блума и скетчам нужны равномерные биты.
+inline uint64_t mix_hash(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+
+  return x;
+}
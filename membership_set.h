@@ -0,0 +1,177 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+#include <vector>
+#include "hash.h"
+
+// Неизменяемое множество для быстрых проверок принадлежности.
+// Целые числа из небольшого диапазона хранятся плотной битовой картой. Для
+// остальных множеств сначала проверяется блочный фильтр Блума (одно 64-битное
+// слово на ключ), и только при совпадении - открытая хеш-таблица. Промахи,
+// которых при фильтрации по черному списку большинство, обычно отсекаются
+// одним обращением к памяти.
+template<typename T>
+class MembershipSet {
+ public:
+  // Диапазон значений, до которого выгодна битовая карта, в битах на элемент
+  static constexpr uint64_t kDenseBitsPerElement = 64;
+  static constexpr uint64_t kDenseMinBits = uint64_t(1) << 16;
+
+  template<typename Set>
+  explicit MembershipSet(const Set& set) {
+    if constexpr (std::is_integral_v<T>) {
+      if (set.begin() != set.end() && build_bitmap(set)) return;
+    }
+    build_hashed(set);
+  }
+
+  bool is_dense() const {
+
+    return dense;
+  }
+
+  // Хеш значения; позволяет заранее посчитать хеши пакета и запросить нужные слова
+  uint64_t hash(const T& value) const {
+
+    return mix_hash(std::hash<T>()(value));
+  }
+
+  // Подсказка процессору загрузить слово фильтра Блума для будущей проверки
+  void prefetch(uint64_t hash) const {
+#if defined(__GNUC__)
+    if (!dense) {
+      __builtin_prefetch(&bloom[hash & bloom_mask]);
+    }
+#else
+    (void)hash;
+#endif
+  }
+
+  bool contains(const T& value) const {
+    if (dense) {
+
+      return contains_dense(value);
+    }
+
+    return contains_hashed(value, hash(value));
+  }
+
+  bool contains(const T& value, uint64_t hash) const {
+    if (dense) {
+
+      return contains_dense(value);
+    }
+
+    return contains_hashed(value, hash);
+  }
+
+ private:
+  // Четыре бита в слове фильтра берутся из старших разрядов хеша
+  static uint64_t bloom_bits(uint64_t hash) {
+
+    return (uint64_t(1) << ((hash >> 40) & 63)) | (uint64_t(1) << ((hash >> 46) & 63))
+        | (uint64_t(1) << ((hash >> 52) & 63)) | (uint64_t(1) << ((hash >> 58) & 63));
+  }
+
+  static size_t round_up_pow2(size_t n) {
+    size_t result = 1;
+    while (result < n) {
+      result <<= 1;
+    }
+
+    return result;
+  }
+
+  static uint64_t offset_of(T value, T base) {
+
+    return static_cast<uint64_t>(value) - static_cast<uint64_t>(base);
+  }
+
+  template<typename Set>
+  bool build_bitmap(const Set& set) {
+    T min_value = *set.begin();
+    T max_value = *set.begin();
+    size_t size = 0;
+    for (const auto& elem : set) {
+      min_value = elem < min_value ? elem : min_value;
+      max_value = max_value < elem ? elem : max_value;
+      ++size;
+    }
+    uint64_t span = offset_of(max_value, min_value);
+    uint64_t limit = std::max(kDenseMinBits, kDenseBitsPerElement * size);
+    if (span >= limit) return false;
+
+    dense = true;
+    base = min_value;
+    range = span + 1;
+    bitmap.assign(range / 64 + 1, 0);
+    for (const auto& elem : set) {
+      uint64_t offset = offset_of(elem, base);
+      bitmap[offset / 64] |= uint64_t(1) << (offset % 64);
+    }
+
+    return true;
+  }
+
+  template<typename Set>
+  void build_hashed(const Set& set) {
+    size_t size = 0;
+    for (auto it = set.begin(); it != set.end(); ++it) {
+      ++size;
+    }
+    bloom.assign(round_up_pow2(size / 4 + 1), 0);
+    bloom_mask = bloom.size() - 1;
+    slots.resize(round_up_pow2(size * 2 + 2));
+    used.assign(slots.size(), 0);
+    slot_mask = slots.size() - 1;
+
+    for (const auto& elem : set) {
+      uint64_t h = hash(elem);
+      bloom[h & bloom_mask] |= bloom_bits(h);
+      size_t index = (h >> 20) & slot_mask;
+      while (used[index] && !(slots[index] == elem)) {
+        index = (index + 1) & slot_mask;
+      }
+      slots[index] = elem;
+      used[index] = 1;
+    }
+  }
+
+  bool contains_dense(const T& value) const {
+    if constexpr (std::is_integral_v<T>) {
+      uint64_t offset = offset_of(value, base);
+      if (offset >= range) return false;
+
+      return (bitmap[offset / 64] >> (offset % 64)) & 1;
+    } else {
+
+      return false;
+    }
+  }
+
+  bool contains_hashed(const T& value, uint64_t h) const {
+    uint64_t bits = bloom_bits(h);
+    if ((bloom[h & bloom_mask] & bits) != bits) return false;
+
+    for (size_t index = (h >> 20) & slot_mask; used[index]; index = (index + 1) & slot_mask) {
+      if (slots[index] == value) return true;
+    }
+
+    return false;
+  }
+
+  bool dense = false;
+  T base{};
+  uint64_t range = 0;
+  std::vector<uint64_t> bitmap;
+
+  std::vector<uint64_t> bloom;
+  size_t bloom_mask = 0;
+  std::vector<T> slots;
+  std::vector<unsigned char> used;
+  size_t slot_mask = 0;
+};
@@ -0,0 +1,274 @@
+#pragma once
+
+#include <charconv>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "adapter.h"
+
+// Один запуск стадии: обрабатывает пакет элементов и оставляет ответ в output()
+template<typename T>
+class BatchKernel {
+ public:
+  virtual ~BatchKernel() = default;
+
+  // Возвращает false, если стадии больше не нужны элементы
+  virtual bool process(std::span<const T> batch) = 0;
+
+  virtual const std::vector<T>& output() const = 0;
+};
+
+// Описание стадии, собранное во время выполнения. Неизменяемо; для каждого
+// запуска создает ядро со своим состоянием (счетчик take, множество distinct).
+template<typename T>
+class RuntimeStage {
+ public:
+  virtual ~RuntimeStage() = default;
+
+  virtual std::unique_ptr<BatchKernel<T>> start() const = 0;
+};
+
+// Стадия, ядром которой служит потоковый адаптер. Виртуальный вызов делается
+// один раз на пакет, внутри пакета приемник адаптера встраивается компилятором.
+template<typename T, typename Stage>
+class AdapterStage : public RuntimeStage<T> {
+  static_assert(Stage::is_streaming, "Only streaming adapters can serve as runtime stages");
+  static_assert(std::is_same_v<typename Stage::template output_type<T>, T>, "Runtime stages must keep the element type");
+
+ public:
+  explicit AdapterStage(Stage stage) : stage(stage) {}
+
+  std::unique_ptr<BatchKernel<T>> start() const override {
+
+    return std::make_unique<Kernel>(stage);
+  }
+
+ private:
+  class Kernel : public BatchKernel<T> {
+   public:
+    explicit Kernel(const Stage& stage) {
+      sink.emplace(stage.template sink<T>(AppendTo<T>{&buffer}));
+    }
+
+    bool process(std::span<const T> batch) override {
+      buffer.clear();
+      for (const auto& elem : batch) {
+        if (!(*sink)(elem)) return false;
+      }
+
+      return true;
+    }
+
+    const std::vector<T>& output() const override {
+
+      return buffer;
+    }
+
+   private:
+    std::vector<T> buffer;
+    std::optional<decltype(std::declval<const Stage&>().template sink<T>(AppendTo<T>{nullptr}))> sink;
+  };
+
+  Stage stage;
+};
+
+template<typename T, typename Stage>
+std::shared_ptr<const RuntimeStage<T>> make_runtime_stage(Stage stage) {
+
+  return std::make_shared<AdapterStage<T, Stage>>(stage);
+}
+
+// Цепочка стадий, собранная во время выполнения. Элементы передаются между
+// стадиями пакетами по kBatchSize, поэтому стоимость косвенного вызова
+// делится на весь пакет.
+template<typename T>
+class RuntimePipeline : public Adapter<RuntimePipeline<T>> {
+ public:
+  static constexpr size_t kBatchSize = 1024;
+
+  RuntimePipeline() = default;
+
+  explicit RuntimePipeline(std::vector<std::shared_ptr<const RuntimeStage<T>>> stages) : stages(std::move(stages)) {}
+
+  void push_back(std::shared_ptr<const RuntimeStage<T>> stage) {
+    stages.push_back(std::move(stage));
+  }
+
+  size_t size() const {
+
+    return stages.size();
+  }
+
+  template<typename Container>
+  std::vector<T> apply(const Container& container) const {
+    std::vector<T> result;
+    run(container, result);
+
+    return result;
+  }
+
+  // Записывает ответ в result, переиспользуя его память
+  template<typename Container>
+  void run(const Container& container, std::vector<T>& result) const {
+    result.clear();
+    std::vector<std::unique_ptr<BatchKernel<T>>> kernels;
+    kernels.reserve(stages.size());
+    for (const auto& stage : stages) {
+      kernels.push_back(stage->start());
+    }
+
+    // Возвращает false, когда какой-то стадии больше не нужен вход
+    auto push_batch = [&](std::span<const T> batch) {
+      bool more = true;
+      for (auto& kernel : kernels) {
+        more = kernel->process(batch) && more;
+        batch = kernel->output();
+        if (batch.empty()) break;
+      }
+      result.insert(result.end(), batch.begin(), batch.end());
+
+      return more;
+    };
+
+    if constexpr (std::ranges::contiguous_range<Container>) {
+      std::span<const T> input(std::data(container), std::size(container));
+      for (size_t offset = 0; offset < input.size(); offset += kBatchSize) {
+        if (!push_batch(input.subspan(offset, std::min(kBatchSize, input.size() - offset)))) return;
+      }
+    } else {
+      std::vector<T> batch;
+      batch.reserve(kBatchSize);
+      for (const auto& elem : container) {
+        batch.push_back(elem);
+        if (batch.size() == kBatchSize) {
+          if (!push_batch(batch)) return;
+          batch.clear();
+        }
+      }
+      if (!batch.empty()) {
+        push_batch(batch);
+      }
+    }
+  }
+
+ private:
+  std::vector<std::shared_ptr<const RuntimeStage<T>>> stages;
+};
+
+// Словарь именованных стадий. Спецификация цепочки - строка вида
+// "filter gt 10 | transform mul 3 | distinct | take 5": стадии разделены '|',
+// имя стадии и параметры - пробелами. Для арифметических типов заранее
+// зарегистрированы filter (lt, le, gt, ge, eq, ne), transform (add, sub, mul, div,
+// min, max), take, drop и distinct.
+template<typename T>
+class RuntimeStageRegistry {
+ public:
+  using Args = std::vector<std::string_view>;
+  using Factory = std::function<std::shared_ptr<const RuntimeStage<T>>(const Args&)>;
+
+  RuntimeStageRegistry() {
+    add("take", [](const Args& args) { return make_runtime_stage<T>(Take(parse<size_t>(args, 0, 1))); });
+    add("drop", [](const Args& args) { return make_runtime_stage<T>(Drop(parse<size_t>(args, 0, 1))); });
+    add("distinct", [](const Args& args) {
+      expect_args(args, 0);
+
+      return make_runtime_stage<T>(distinct());
+    });
+    if constexpr (std::is_arithmetic_v<T>) {
+      add("filter", &make_filter);
+      add("transform", &make_transform);
+    }
+  }
+
+  void add(std::string name, Factory factory) {
+    factories[std::move(name)] = std::move(factory);
+  }
+
+  // Регистрирует готовый адаптер как стадию без параметров
+  template<typename Stage>
+  void add_adapter(std::string name, Stage stage) {
+    add(std::move(name), [stage](const Args& args) {
+      expect_args(args, 0);
+
+      return make_runtime_stage<T>(stage);
+    });
+  }
+
+  RuntimePipeline<T> build(std::string_view spec) const {
+    RuntimePipeline<T> pipeline;
+    for (std::string_view stage_spec : spec | split('|')) {
+      auto words = stage_spec | split_any(" \t\r\n");
+      if (words.empty()) {
+        throw std::invalid_argument("Empty stage in pipeline spec");
+      }
+      auto factory = factories.find(std::string(words.front()));
+      if (factory == factories.end()) {
+        throw std::invalid_argument("Unknown pipeline stage: " + std::string(words.front()));
+      }
+      pipeline.push_back(factory->second(Args(words.begin() + 1, words.end())));
+    }
+
+    return pipeline;
+  }
+
+ private:
+  static void expect_args(const Args& args, size_t count) {
+    if (args.size() != count) {
+      throw std::invalid_argument("Wrong number of stage parameters");
+    }
+  }
+
+  template<typename Value>
+  static Value parse(const Args& args, size_t index, size_t count) {
+    expect_args(args, count);
+    Value value{};
+    std::string_view text = args[index];
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (error != std::errc() || end != text.data() + text.size()) {
+      throw std::invalid_argument("Bad stage parameter: " + std::string(text));
+    }
+
+    return value;
+  }
+
+  static std::shared_ptr<const RuntimeStage<T>> make_filter(const Args& args) {
+    T value = parse<T>(args, 1, 2);
+    std::string_view op = args[0];
+    // Для каждой операции свое ядро, поэтому внутри пакета нет ветвления по ней
+    if (op == "lt") return make_runtime_stage<T>(Filter([value](const T& x) { return x < value; }));
+    if (op == "le") return make_runtime_stage<T>(Filter([value](const T& x) { return x <= value; }));
+    if (op == "gt") return make_runtime_stage<T>(Filter([value](const T& x) { return x > value; }));
+    if (op == "ge") return make_runtime_stage<T>(Filter([value](const T& x) { return x >= value; }));
+    if (op == "eq") return make_runtime_stage<T>(Filter([value](const T& x) { return x == value; }));
+    if (op == "ne") return make_runtime_stage<T>(Filter([value](const T& x) { return x != value; }));
+
+    throw std::invalid_argument("Unknown filter operation: " + std::string(op));
+  }
+
+  static std::shared_ptr<const RuntimeStage<T>> make_transform(const Args& args) {
+    T value = parse<T>(args, 1, 2);
+    std::string_view op = args[0];
+    if (op == "add") return make_runtime_stage<T>(Transform([value](const T& x) -> T { return x + value; }));
+    if (op == "sub") return make_runtime_stage<T>(Transform([value](const T& x) -> T { return x - value; }));
+    if (op == "mul") return make_runtime_stage<T>(Transform([value](const T& x) -> T { return x * value; }));
+    if (op == "div") {
+      if (value == T()) {
+        throw std::invalid_argument("Division by zero in transform stage");
+      }
+
+      return make_runtime_stage<T>(Transform([value](const T& x) -> T { return x / value; }));
+    }
+    if (op == "min") return make_runtime_stage<T>(Transform([value](const T& x) -> T { return std::min(x, value); }));
+    if (op == "max") return make_runtime_stage<T>(Transform([value](const T& x) -> T { return std::max(x, value); }));
+
+    throw std::invalid_argument("Unknown transform operation: " + std::string(op));
+  }
+
+  std::unordered_map<std::string, Factory> factories;
+};
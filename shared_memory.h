@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Сегмент разделяемой памяти POSIX. Имя удаляется сразу после отображения, поэтому
+// сегмент доступен только этому процессу и его потомкам после fork и освобождается
+// вместе с последним отображением.
+class SharedSegment {
+ public:
+  explicit SharedSegment(size_t size) : size_(size == 0 ? 1 : size) {
+    static std::atomic<unsigned> counter{0};
+    std::string name = "/adapters-" + std::to_string(getpid()) + "-" + std::to_string(counter++);
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+      throw std::runtime_error("Cannot create shared memory segment");
+    }
+    shm_unlink(name.c_str());
+    if (ftruncate(fd, static_cast<off_t>(size_)) != 0) {
+      close(fd);
+      throw std::runtime_error("Cannot resize shared memory segment");
+    }
+    void* mapped = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+      throw std::runtime_error("Cannot map shared memory segment");
+    }
+    data_ = static_cast<unsigned char*>(mapped);
+  }
+
+  SharedSegment(const SharedSegment&) = delete;
+
+  SharedSegment& operator=(const SharedSegment&) = delete;
+
+  ~SharedSegment() {
+    munmap(data_, size_);
+  }
+
+  unsigned char* data() const {
+
+    return data_;
+  }
+
+  size_t size() const {
+
+    return size_;
+  }
+
+ private:
+  size_t size_;
+  unsigned char* data_;
+};
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "hash.h"
+
+// Оценка числа различных элементов (HyperLogLog). Занимает 2^precision байт,
+// относительная погрешность около 1.04 / sqrt(2^precision). Скетчи с одинаковой
+// точностью объединяются поэлементным максимумом регистров.
+template<typename T>
+class HyperLogLog {
+ public:
+  static constexpr int kMinPrecision = 4;
+  static constexpr int kMaxPrecision = 18;
+
+  explicit HyperLogLog(int precision = 12) : precision_(precision) {
+    if (precision < kMinPrecision || precision > kMaxPrecision) {
+      throw std::invalid_argument("HyperLogLog precision must be in [4, 18]");
+    }
+    registers.assign(size_t(1) << precision, 0);
+  }
+
+  void add(const T& value) {
+    uint64_t hash = mix_hash(std::hash<T>()(value));
+    size_t index = hash >> (64 - precision_);
+    // Граничный бит ограничивает ранг, когда оставшиеся биты нулевые
+    uint64_t rest = (hash << precision_) | (uint64_t(1) << (precision_ - 1));
+    uint8_t rank = static_cast<uint8_t>(std::countl_zero(rest) + 1);
+    registers[index] = std::max(registers[index], rank);
+  }
+
+  void merge(const HyperLogLog& other) {
+    if (other.precision_ != precision_) {
+      throw std::invalid_argument("Cannot merge HyperLogLog sketches of different precision");
+    }
+    for (size_t i = 0; i < registers.size(); ++i) {
+      registers[i] = std::max(registers[i], other.registers[i]);
+    }
+  }
+
+  double estimate() const {
+    double m = static_cast<double>(registers.size());
+    double sum = 0;
+    size_t zeros = 0;
+    for (uint8_t rank : registers) {
+      sum += std::ldexp(1.0, -rank);
+      zeros += rank == 0;
+    }
+    double alpha = 0.7213 / (1 + 1.079 / m);
+    double estimate = alpha * m * m / sum;
+    // Для малых мощностей точнее подсчет пустых регистров (linear counting)
+    if (estimate <= 2.5 * m && zeros > 0) {
+
+      return m * std::log(m / static_cast<double>(zeros));
+    }
+
+    return estimate;
+  }
+
+  int precision() const {
+
+    return precision_;
+  }
+
+ private:
+  int precision_;
+  std::vector<uint8_t> registers;
+};
+
+// Скетч квантилей KLL. Уровень h хранит элементы веса 2^h; переполненный уровень
+// сортируется, и каждый второй элемент (со случайным сдвигом) поднимается выше.
+// Память O(k log(n / k)), ранговая погрешность порядка 1 / k. Скетчи объединяются
+// склейкой уровней с последующим сжатием.
+template<typename T, typename Comparator = std::less<>>
+class KllSketch {
+ public:
+  explicit KllSketch(size_t k = 200, Comparator comp = Comparator()) : k(std::max<size_t>(k, 8)), comp(comp) {
+    levels.emplace_back();
+    update_capacities();
+  }
+
+  void add(const T& value) {
+    levels[0].push_back(value);
+    ++count;
+    ++stored;
+    if (stored >= total_capacity) {
+      compress();
+    }
+  }
+
+  void merge(const KllSketch& other) {
+    if (levels.size() < other.levels.size()) {
+      levels.resize(other.levels.size());
+      update_capacities();
+    }
+    for (size_t h = 0; h < other.levels.size(); ++h) {
+      levels[h].insert(levels[h].end(), other.levels[h].begin(), other.levels[h].end());
+    }
+    count += other.count;
+    stored += other.stored;
+    compress();
+  }
+
+  size_t size() const {
+
+    return count;
+  }
+
+  bool empty() const {
+
+    return count == 0;
+  }
+
+  // Элемент с долей q в отсортированном входе, q из [0, 1]
+  T quantile(double q) const {
+
+    return quantiles({q}).front();
+  }
+
+  std::vector<T> quantiles(const std::vector<double>& qs) const {
+    if (empty()) {
+      throw std::out_of_range("Sketch is empty");
+    }
+    std::vector<std::pair<T, uint64_t>> weighted;
+    uint64_t total = 0;
+    for (size_t h = 0; h < levels.size(); ++h) {
+      for (const auto& item : levels[h]) {
+        weighted.emplace_back(item, uint64_t(1) << h);
+        total += uint64_t(1) << h;
+      }
+    }
+    std::sort(weighted.begin(), weighted.end(), [this](const auto& lhs, const auto& rhs) {
+      return comp(lhs.first, rhs.first);
+    });
+
+    std::vector<T> result;
+    result.reserve(qs.size());
+    for (double q : qs) {
+      double target = std::clamp(q, 0.0, 1.0) * static_cast<double>(total);
+      uint64_t cumulative = 0;
+      auto it = weighted.begin();
+      for (; it + 1 != weighted.end(); ++it) {
+        cumulative += it->second;
+        if (static_cast<double>(cumulative) >= target) break;
+      }
+      result.push_back(it->first);
+    }
+
+    return result;
+  }
+
+ private:
+  // Емкость уровня убывает геометрически с удалением от верхнего. Емкости
+  // зависят только от числа уровней, поэтому пересчитываются при его росте.
+  void update_capacities() {
+    capacities.resize(levels.size());
+    total_capacity = 0;
+    for (size_t h = 0; h < levels.size(); ++h) {
+      size_t depth = levels.size() - h - 1;
+      capacities[h] = std::max<size_t>(2, static_cast<size_t>(std::ceil(k * std::pow(2.0 / 3.0, depth))));
+      total_capacity += capacities[h];
+    }
+  }
+
+  // Сжимает переполненные уровни, пока элементы не уместятся в суммарную емкость
+  void compress() {
+    while (stored >= total_capacity) {
+      size_t h = 0;
+      while (levels[h].size() < capacities[h]) {
+        ++h;
+      }
+      compact(h);
+    }
+  }
+
+  void compact(size_t h) {
+    if (h + 1 == levels.size()) {
+      levels.emplace_back();
+      update_capacities();
+    }
+    auto& level = levels[h];
+    std::sort(level.begin(), level.end(), comp);
+    // Нечетный элемент остается на уровне, чтобы сохранить общий вес
+    std::vector<T> kept;
+    if (level.size() % 2 == 1) {
+      kept.push_back(level.back());
+      level.pop_back();
+    }
+    size_t offset = std::uniform_int_distribution<size_t>(0, 1)(rng);
+    for (size_t i = offset; i < level.size(); i += 2) {
+      levels[h + 1].push_back(level[i]);
+    }
+    stored -= level.size() / 2;
+    level = std::move(kept);
+  }
+
+  size_t k;
+  Comparator comp;
+  std::vector<std::vector<T>> levels;
+  std::vector<size_t> capacities;
+  size_t total_capacity = 0;
+  // Число хранимых элементов на всех уровнях
+  size_t stored = 0;
+  size_t count = 0;
+  std::mt19937_64 rng;
+};
@@ -0,0 +1,293 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Вектор, хранящий первые N элементов внутри объекта. Пока размер не превышает N,
+// обращений к куче нет; при переполнении элементы переносятся в динамический буфер.
+template<typename T, size_t N>
+class SmallVector {
+ public:
+  using value_type = T;
+  using size_type = size_t;
+  using reference = T&;
+  using const_reference = const T&;
+  using iterator = T*;
+  using const_iterator = const T*;
+  using reverse_iterator = std::reverse_iterator<iterator>;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+  SmallVector() : data_(inline_storage()), size_(0), capacity_(N) {}
+
+  SmallVector(std::initializer_list<T> init) : SmallVector(init.begin(), init.end()) {}
+
+  template<typename InputIt>
+  SmallVector(InputIt first, InputIt last) : SmallVector() {
+    for (; first != last; ++first) {
+      push_back(*first);
+    }
+  }
+
+  SmallVector(const SmallVector& other) : SmallVector() {
+    reserve(other.size_);
+    std::uninitialized_copy(other.begin(), other.end(), data_);
+    size_ = other.size_;
+  }
+
+  SmallVector(SmallVector&& other) noexcept(std::is_nothrow_move_constructible_v<T>) : SmallVector() {
+    steal(std::move(other));
+  }
+
+  SmallVector& operator=(const SmallVector& other) {
+    if (this != &other) {
+      clear();
+      reserve(other.size_);
+      std::uninitialized_copy(other.begin(), other.end(), data_);
+      size_ = other.size_;
+    }
+
+    return *this;
+  }
+
+  SmallVector& operator=(SmallVector&& other) noexcept(std::is_nothrow_move_constructible_v<T>) {
+    if (this != &other) {
+      clear();
+      release();
+      steal(std::move(other));
+    }
+
+    return *this;
+  }
+
+  ~SmallVector() {
+    clear();
+    release();
+  }
+
+  void push_back(const T& value) {
+    emplace_back(value);
+  }
+
+  void push_back(T&& value) {
+    emplace_back(std::move(value));
+  }
+
+  template<typename... Args>
+  T& emplace_back(Args&&... args) {
+    if (size_ == capacity_) {
+      // Аргумент может ссылаться на элемент самого вектора, поэтому сначала создаем копию
+      T value(std::forward<Args>(args)...);
+      grow(capacity_ * 2 + 1);
+      T* created = ::new (static_cast<void*>(data_ + size_)) T(std::move(value));
+      ++size_;
+
+      return *created;
+    }
+    T* created = ::new (static_cast<void*>(data_ + size_)) T(std::forward<Args>(args)...);
+    ++size_;
+
+    return *created;
+  }
+
+  void pop_back() {
+    data_[--size_].~T();
+  }
+
+  void reserve(size_t capacity) {
+    if (capacity > capacity_) {
+      grow(capacity);
+    }
+  }
+
+  void clear() {
+    std::destroy(begin(), end());
+    size_ = 0;
+  }
+
+  // Находятся ли элементы во встроенном буфере
+  bool is_inline() const {
+
+    return data_ == inline_storage();
+  }
+
+  size_t size() const {
+
+    return size_;
+  }
+
+  size_t capacity() const {
+
+    return capacity_;
+  }
+
+  bool empty() const {
+
+    return size_ == 0;
+  }
+
+  T* data() {
+
+    return data_;
+  }
+
+  const T* data() const {
+
+    return data_;
+  }
+
+  T& operator[](size_t index) {
+
+    return *std::launder(data_ + index);
+  }
+
+  const T& operator[](size_t index) const {
+
+    return *std::launder(data_ + index);
+  }
+
+  T& front() {
+
+    return (*this)[0];
+  }
+
+  const T& front() const {
+
+    return (*this)[0];
+  }
+
+  T& back() {
+
+    return (*this)[size_ - 1];
+  }
+
+  const T& back() const {
+
+    return (*this)[size_ - 1];
+  }
+
+  iterator begin() {
+
+    return data_;
+  }
+
+  iterator end() {
+
+    return data_ + size_;
+  }
+
+  const_iterator begin() const {
+
+    return data_;
+  }
+
+  const_iterator end() const {
+
+    return data_ + size_;
+  }
+
+  reverse_iterator rbegin() {
+
+    return reverse_iterator(end());
+  }
+
+  reverse_iterator rend() {
+
+    return reverse_iterator(begin());
+  }
+
+  const_reverse_iterator rbegin() const {
+
+    return const_reverse_iterator(end());
+  }
+
+  const_reverse_iterator rend() const {
+
+    return const_reverse_iterator(begin());
+  }
+
+  friend bool operator==(const SmallVector& lhs, const SmallVector& rhs) {
+
+    return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
+  }
+
+  friend bool operator!=(const SmallVector& lhs, const SmallVector& rhs) {
+
+    return !(lhs == rhs);
+  }
+
+ private:
+  // Адрес встроенного буфера. Это еще не указатель на живой объект, поэтому
+  // std::launder применяется только при обращении к созданным элементам.
+  T* inline_storage() {
+
+    return reinterpret_cast<T*>(buffer);
+  }
+
+  const T* inline_storage() const {
+
+    return reinterpret_cast<const T*>(buffer);
+  }
+
+  // Переносит элементы в неинициализированную память dest. Элементы с бросающим
+  // перемещением копируются (как в std::vector), поэтому при исключении источник
+  // не меняется, а уже созданные элементы в dest разрушаются.
+  static void relocate(T* first, T* last, T* dest) {
+    T* current = dest;
+    try {
+      for (; first != last; ++first, ++current) {
+        ::new (static_cast<void*>(current)) T(std::move_if_noexcept(*first));
+      }
+    } catch (...) {
+      std::destroy(dest, current);
+      throw;
+    }
+  }
+
+  void grow(size_t capacity) {
+    T* heap = static_cast<T*>(::operator new(capacity * sizeof(T)));
+    try {
+      relocate(begin(), end(), heap);
+    } catch (...) {
+      ::operator delete(heap);
+      throw;
+    }
+    std::destroy(begin(), end());
+    release();
+    data_ = heap;
+    capacity_ = capacity;
+  }
+
+  void release() {
+    if (!is_inline()) {
+      ::operator delete(data_);
+      data_ = inline_storage();
+      capacity_ = N;
+    }
+  }
+
+  void steal(SmallVector&& other) {
+    if (other.is_inline()) {
+      relocate(other.begin(), other.end(), data_);
+      size_ = other.size_;
+      other.clear();
+    } else {
+      data_ = other.data_;
+      size_ = other.size_;
+      capacity_ = other.capacity_;
+      other.data_ = other.inline_storage();
+      other.size_ = 0;
+      other.capacity_ = N;
+    }
+  }
+
+  alignas(T) unsigned char buffer[N == 0 ? 1 : N * sizeof(T)];
+  T* data_;
+  size_t size_;
+  size_t capacity_;
+};
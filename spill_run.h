@@ -0,0 +1,130 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+// Отсортированная серия, сброшенная во временный файл. Читается блоками
+// фиксированного размера, поэтому в памяти одновременно находится только текущий
+// блок. Файл удаляется при закрытии.
+template<typename T>
+class SpillRun {
+  static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable elements can be spilled to disk");
+
+ public:
+  // Однопроходный итератор; все копии разделяют позицию чтения серии
+  class iterator {
+   public:
+    using value_type = T;
+
+    iterator() : run(nullptr) {}
+
+    explicit iterator(const SpillRun* run) : run(run) {}
+
+    const T& operator*() const {
+
+      return run->current();
+    }
+
+    iterator& operator++() {
+      run->advance();
+
+      return *this;
+    }
+
+    friend bool operator==(const iterator& lhs, const iterator& rhs) {
+
+      return lhs.at_end() == rhs.at_end();
+    }
+
+   private:
+    bool at_end() const {
+
+      return run == nullptr || !run->available();
+    }
+
+    const SpillRun* run;
+  };
+
+  using value_type = T;
+
+  SpillRun() : file(std::tmpfile(), &std::fclose) {
+    if (!file) {
+      throw std::runtime_error("Cannot create temporary file for spilled run");
+    }
+  }
+
+  explicit SpillRun(const std::vector<T>& items) : SpillRun() {
+    write(items.data(), items.size());
+  }
+
+  // Дописывает элементы в конец серии
+  void write(const T* items, size_t count) {
+    if (std::fwrite(items, sizeof(T), count, file.get()) != count) {
+      throw std::runtime_error("Cannot write spilled run to temporary file");
+    }
+    size_ += count;
+  }
+
+  size_t size() const {
+
+    return size_;
+  }
+
+  // Возвращает чтение в начало серии с буфером из block элементов
+  void rewind(size_t block) {
+    std::rewind(file.get());
+    block_size = std::max<size_t>(block, 1);
+    buffer.clear();
+    position = 0;
+    consumed = 0;
+  }
+
+  iterator begin() const {
+
+    return iterator(this);
+  }
+
+  iterator end() const {
+
+    return iterator();
+  }
+
+ private:
+  bool available() const {
+    if (position < buffer.size()) return true;
+    if (consumed == size_) return false;
+
+    size_t count = std::min(block_size, size_ - consumed);
+    buffer.resize(count);
+    if (std::fread(buffer.data(), sizeof(T), count, file.get()) != count) {
+      throw std::runtime_error("Cannot read spilled run from temporary file");
+    }
+    consumed += count;
+    position = 0;
+
+    return true;
+  }
+
+  const T& current() const {
+    available();
+
+    return buffer[position];
+  }
+
+  void advance() const {
+    available();
+    ++position;
+  }
+
+  std::unique_ptr<std::FILE, int (*)(std::FILE*)> file;
+  size_t size_ = 0;
+  size_t block_size = 1;
+  mutable std::vector<T> buffer;
+  mutable size_t position = 0;
+  mutable size_t consumed = 0;
+};
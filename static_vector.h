@@ -0,0 +1,148 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
+#include <stdexcept>
+
+// Вектор емкости N поверх std::array и счетчика элементов. Пригоден для
+// вычислений на этапе компиляции: так Filter, Take и Drop над std::array
+// остаются constexpr, хотя число элементов ответа заранее неизвестно.
+// Элементы должны конструироваться по умолчанию.
+template<typename T, size_t N>
+class StaticVector {
+ public:
+  using value_type = T;
+  using size_type = size_t;
+  using reference = T&;
+  using const_reference = const T&;
+  using iterator = typename std::array<T, N>::iterator;
+  using const_iterator = typename std::array<T, N>::const_iterator;
+  using reverse_iterator = std::reverse_iterator<iterator>;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+  constexpr StaticVector() = default;
+
+  constexpr StaticVector(std::initializer_list<T> init) : StaticVector(init.begin(), init.end()) {}
+
+  template<typename InputIt>
+  constexpr StaticVector(InputIt first, InputIt last) {
+    for (; first != last; ++first) {
+      push_back(*first);
+    }
+  }
+
+  constexpr void push_back(const T& value) {
+    if (size_ == N) {
+      throw std::length_error("StaticVector capacity exceeded");
+    }
+    items[size_++] = value;
+  }
+
+  constexpr void pop_back() {
+    --size_;
+  }
+
+  // Емкость фиксирована, поэтому резервировать нечего
+  constexpr void reserve(size_t) {}
+
+  constexpr void clear() {
+    size_ = 0;
+  }
+
+  constexpr size_t size() const {
+
+    return size_;
+  }
+
+  static constexpr size_t capacity() {
+
+    return N;
+  }
+
+  constexpr bool empty() const {
+
+    return size_ == 0;
+  }
+
+  constexpr T& operator[](size_t index) {
+
+    return items[index];
+  }
+
+  constexpr const T& operator[](size_t index) const {
+
+    return items[index];
+  }
+
+  constexpr T& front() {
+
+    return items[0];
+  }
+
+  constexpr const T& front() const {
+
+    return items[0];
+  }
+
+  constexpr T& back() {
+
+    return items[size_ - 1];
+  }
+
+  constexpr const T& back() const {
+
+    return items[size_ - 1];
+  }
+
+  constexpr iterator begin() {
+
+    return items.begin();
+  }
+
+  constexpr iterator end() {
+
+    return items.begin() + size_;
+  }
+
+  constexpr const_iterator begin() const {
+
+    return items.begin();
+  }
+
+  constexpr const_iterator end() const {
+
+    return items.begin() + size_;
+  }
+
+  constexpr reverse_iterator rbegin() {
+
+    return reverse_iterator(end());
+  }
+
+  constexpr reverse_iterator rend() {
+
+    return reverse_iterator(begin());
+  }
+
+  constexpr const_reverse_iterator rbegin() const {
+
+    return const_reverse_iterator(end());
+  }
+
+  constexpr const_reverse_iterator rend() const {
+
+    return const_reverse_iterator(begin());
+  }
+
+  friend constexpr bool operator==(const StaticVector& lhs, const StaticVector& rhs) {
+
+    return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
+  }
+
+ private:
+  std::array<T, N> items{};
+  size_t size_ = 0;
+};
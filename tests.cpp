@@ -1,6 +1,75 @@
 #include <gtest/gtest.h>
+#if __has_include(<sys/resource.h>)
+#include <sys/resource.h>
+#endif
+#include <atomic>
+#include <cctype>
+#include <cstdlib>
+#include <list>
+#include <map>
+#include <new>
 #include <vector>
 #include "adapter.h"
+#include "runtime_pipeline.h"
+
+// Число выделений памяти через operator new за время работы тестов. Заменены
+// все невыровненные формы, чтобы память из них освобождалась парной функцией.
+static std::atomic<size_t> allocations{0};
+
+static void* counted_alloc(size_t size) noexcept {
+  ++allocations;
+
+  return std::malloc(size == 0 ? 1 : size);
+}
+
+void* operator new(size_t size) {
+  if (void* ptr = counted_alloc(size)) return ptr;
+
+  throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+  if (void* ptr = counted_alloc(size)) return ptr;
+
+  throw std::bad_alloc();
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+
+  return counted_alloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+
+  return counted_alloc(size);
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void operator delete(void* ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+  std::free(ptr);
+}
+#pragma GCC diagnostic pop
 
 TEST(TransformTest, MultiplyByTwo) {
   std::vector<int> vec = {1, 2, 3, 4, 5};
@@ -587,7 +656,7 @@ TEST(FirstTest, IntVector) {
 TEST(FirstTest, DoubleVector) {
   std::vector<double> vec = {2.3, 1.5, 3.6, 1.2};
   auto first_val = vec | first();
-  EXPECT_DOUBLE_EQ(first_val, 2.3);
+  EXPECT_DOUBLE_EQ(*first_val, 2.3);
 }
 
 TEST(FirstTest, StringVector) {
@@ -598,7 +667,7 @@ TEST(FirstTest, StringVector) {
 
 TEST(FirstTest, EmptyVector) {
   std::vector<int> vec;
-  EXPECT_THROW(vec | first(), std::out_of_range);
+  EXPECT_FALSE((vec | first()).has_value());
 }
 
 TEST(LastTest, IntVector) {
@@ -610,7 +679,7 @@ TEST(LastTest, IntVector) {
 TEST(LastTest, DoubleVector) {
   std::vector<double> vec = {2.3, 1.5, 3.6, 1.2};
   auto last_val = vec | last();
-  EXPECT_DOUBLE_EQ(last_val, 1.2);
+  EXPECT_DOUBLE_EQ(*last_val, 1.2);
 }
 
 TEST(LastTest, StringVector) {
@@ -621,7 +690,7 @@ TEST(LastTest, StringVector) {
 
 TEST(LastTest, EmptyVector) {
   std::vector<int> vec;
-  EXPECT_THROW(vec | last(), std::out_of_range);
+  EXPECT_FALSE((vec | last()).has_value());
 }
 
 TEST(AdapterChainTest, FirstAfterSortDistinct) {
@@ -681,4 +750,1184 @@ TEST(IntersectTest, EmptyVector) {
   std::vector<int> vec2 = {};
   auto result = std::vector<int>() | intersect(vec1, vec2);
   EXPECT_TRUE(result.empty());
-}
\ No newline at end of file
+}
+
+TEST(PipelineTest, ComposeWithoutData) {
+  auto pipeline = Filter([](int x) { return x % 2 == 0; })
+      | Transform([](int x) { return x * 10; })
+      | Take(2);
+  std::vector<int> vec = {1, 2, 3, 4, 5, 6};
+  EXPECT_EQ(vec | pipeline, (std::vector<int>{20, 40}));
+}
+
+TEST(PipelineTest, ReusedOnManyInputs) {
+  auto pipeline = Filter([](int x) { return x > 2; }) | Drop(1);
+  auto copy = pipeline;
+  EXPECT_EQ((std::vector<int>{1, 2, 3, 4, 5}) | pipeline, (std::vector<int>{4, 5}));
+  EXPECT_EQ((std::vector<int>{9, 8, 1, 7}) | copy, (std::vector<int>{8, 7}));
+}
+
+TEST(PipelineTest, RunReusesResultBuffer) {
+  auto pipeline = Transform([](int x) { return x + 1; }) | Take(3);
+  std::vector<int> result;
+  pipeline.run(std::vector<int>{1, 2, 3, 4}, result);
+  EXPECT_EQ(result, (std::vector<int>{2, 3, 4}));
+  const int* data = result.data();
+  pipeline.run(std::vector<int>{7, 8}, result);
+  EXPECT_EQ(result, (std::vector<int>{8, 9}));
+  EXPECT_EQ(result.data(), data);
+}
+
+TEST(PipelineTest, RunReusesScratchBuffers) {
+  auto pipeline = Filter([](int x) { return x % 2; }) | sort(std::greater<int>()) | Take(3);
+  std::vector<int> vec;
+  for (int i = 0; i < 100; ++i) {
+    vec.push_back((i * 37) % 101);
+  }
+  std::vector<int> result;
+  pipeline.run(vec, result);
+  size_t before = allocations;
+  for (int i = 0; i < 10; ++i) {
+    pipeline.run(vec, result);
+  }
+  EXPECT_EQ(allocations - before, 0u);
+  EXPECT_EQ(result, (std::vector<int>{99, 97, 95}));
+  EXPECT_EQ(vec | pipeline, result);
+}
+
+TEST(PipelineTest, AdjacentStagesAreFused) {
+  auto filters = Filter([](int x) { return x > 1; }) | Filter([](int x) { return x < 5; });
+  auto transforms = Transform([](int x) { return x * 2; }) | Transform([](int x) { return x + 1; });
+  auto takes = Take(5) | Take(2);
+  auto drops = Drop(1) | Drop(2);
+  EXPECT_EQ(takes.count(), 2u);
+  EXPECT_EQ(drops.count(), 3u);
+  std::vector<int> vec = {1, 2, 3, 4, 5, 6};
+  EXPECT_EQ(vec | filters, (std::vector<int>{2, 3, 4}));
+  EXPECT_EQ(vec | transforms, (std::vector<int>{3, 5, 7, 9, 11, 13}));
+  EXPECT_EQ(vec | takes, (std::vector<int>{1, 2}));
+  EXPECT_EQ(vec | drops, (std::vector<int>{4, 5, 6}));
+}
+
+TEST(PipelineTest, ChangesElementType) {
+  auto pipeline = Filter([](int x) { return x != 2; }) | Transform([](int x) { return std::to_string(x); });
+  std::vector<int> vec = {1, 2, 3};
+  EXPECT_EQ(vec | pipeline, (std::vector<std::string>{"1", "3"}));
+}
+
+TEST(PipelineTest, NonStreamingStages) {
+  auto pipeline = Filter([](int x) { return x % 2; }) | sort(std::greater<int>()) | Take(2);
+  std::vector<int> vec = {5, 1, 4, 9, 3, 8};
+  EXPECT_EQ(vec | pipeline, (std::vector<int>{9, 5}));
+}
+
+TEST(ConstexprTest, ArrayPipelineAtCompileTime) {
+  constexpr std::array<int, 5> source = {5, 3, 1, 4, 2};
+  constexpr auto table = source | Transform([](int x) { return x * 10; }) | sort() | Reverse();
+  static_assert(table == std::array<int, 5>{50, 40, 30, 20, 10});
+  static_assert((source | max_element(std::less<int>())) == 5);
+  static_assert((source | first()) == 5);
+  EXPECT_EQ(table.size(), 5u);
+}
+
+TEST(ConstexprTest, FilterTakeAndDropOnArray) {
+  constexpr std::array<int, 6> source = {5, 2, 8, 1, 9, 4};
+  constexpr auto odd = source | Filter([](int x) { return x % 2 == 1; });
+  static_assert(odd == StaticVector<int, 6>{5, 1, 9});
+  static_assert(odd.size() == 3);
+  constexpr auto middle = source | Drop(1) | Take(3) | sort();
+  static_assert(middle == StaticVector<int, 6>{1, 2, 8});
+  constexpr auto big = source | (Filter([](int x) { return x > 3; }) | Take(2));
+  static_assert(big == StaticVector<int, 6>{5, 8});
+  static_assert((source | Filter([](int x) { return x > 8; }) | first()) == 9);
+  EXPECT_EQ(odd.back(), 9);
+}
+
+TEST(ConstexprTest, ComposedPipelineOnArray) {
+  constexpr auto pipeline = Transform([](int x) { return x + 1; }) | Transform([](int x) { return x * 2; });
+  constexpr auto table = std::array<int, 3>{0, 1, 2} | pipeline;
+  static_assert(table == std::array<int, 3>{2, 4, 6});
+  EXPECT_EQ(table[2], 6);
+}
+
+TEST(StaticSizeTest, TakeAndDropOnArray) {
+  constexpr std::array<int, 5> source = {1, 2, 3, 4, 5};
+  constexpr auto head = source | take<2>();
+  constexpr auto tail = source | drop<3>();
+  constexpr auto everything = source | take<10>();
+  constexpr auto nothing = source | drop<10>();
+  static_assert(head == std::array<int, 2>{1, 2});
+  static_assert(tail == std::array<int, 2>{4, 5});
+  static_assert(everything.size() == 5);
+  static_assert(nothing.empty());
+  EXPECT_EQ(head[1], 2);
+}
+
+TEST(StaticSizeTest, TakeAndDropOnVector) {
+  std::vector<int> vec = {1, 2, 3, 4, 5};
+  EXPECT_EQ(vec | take<3>(), (SmallVector<int, 3>{1, 2, 3}));
+  EXPECT_EQ(vec | drop<3>(), (std::vector<int>{4, 5}));
+  EXPECT_EQ(vec | (Filter([](int x) { return x > 1; }) | take<2>()), (SmallVector<int, 2>{2, 3}));
+}
+
+TEST(StaticSizeTest, CycleAndChunk) {
+  constexpr std::array<int, 2> source = {1, 2};
+  constexpr auto cycled = source | cycle<3>();
+  static_assert(cycled == std::array<int, 6>{1, 2, 1, 2, 1, 2});
+  constexpr auto chunks = cycled | chunk<3>();
+  static_assert(chunks.size() == 2);
+  static_assert(chunks[1] == std::array<int, 3>{2, 1, 2});
+  std::vector<int> vec = {7, 8};
+  EXPECT_EQ(vec | cycle<2>(), (std::vector<int>{7, 8, 7, 8}));
+}
+
+TEST(SmallVectorTest, StaysInlineUpToCapacity) {
+  SmallVector<int, 4> vec;
+  for (int i = 0; i < 4; ++i) {
+    vec.push_back(i);
+  }
+  EXPECT_TRUE(vec.is_inline());
+  EXPECT_EQ(vec, (SmallVector<int, 4>{0, 1, 2, 3}));
+}
+
+TEST(SmallVectorTest, SpillsToHeap) {
+  SmallVector<std::string, 2> vec = {"a", "b"};
+  vec.push_back(vec.front());
+  EXPECT_FALSE(vec.is_inline());
+  EXPECT_EQ(vec.size(), 3u);
+  EXPECT_EQ(vec.back(), "a");
+  SmallVector<std::string, 2> moved = std::move(vec);
+  EXPECT_TRUE(vec.empty());
+  EXPECT_EQ(moved, (SmallVector<std::string, 2>{"a", "b", "a"}));
+}
+
+TEST(SmallVectorTest, CopyAndMoveInline) {
+  SmallVector<std::string, 4> vec = {"x", "y"};
+  SmallVector<std::string, 4> copy = vec;
+  SmallVector<std::string, 4> moved = std::move(copy);
+  EXPECT_EQ(moved, vec);
+  EXPECT_TRUE(moved.is_inline());
+  vec = moved;
+  EXPECT_EQ(vec.size(), 2u);
+}
+
+// Элемент, копирование которого бросает исключение после заданного числа копий
+struct FragileCopy {
+  static inline int copies_left = 0;
+
+  int value;
+
+  explicit FragileCopy(int value) : value(value) {}
+
+  FragileCopy(const FragileCopy& other) : value(other.value) {
+    if (copies_left-- == 0) throw std::runtime_error("copy failed");
+  }
+
+  FragileCopy(FragileCopy&& other) : value(other.value) {}
+};
+
+TEST(SmallVectorTest, GrowthKeepsElementsWhenCopyThrows) {
+  static_assert(std::is_nothrow_move_constructible_v<SmallVector<std::string, 2>>);
+  static_assert(!std::is_nothrow_move_constructible_v<SmallVector<FragileCopy, 2>>);
+  SmallVector<FragileCopy, 2> vec;
+  vec.emplace_back(1);
+  vec.emplace_back(2);
+  FragileCopy::copies_left = 1;
+  EXPECT_THROW(vec.emplace_back(3), std::runtime_error);
+  EXPECT_TRUE(vec.is_inline());
+  ASSERT_EQ(vec.size(), 2u);
+  EXPECT_EQ(vec[0].value, 1);
+  EXPECT_EQ(vec[1].value, 2);
+  FragileCopy::copies_left = 100;
+  vec.emplace_back(3);
+  EXPECT_FALSE(vec.is_inline());
+  EXPECT_EQ(vec.back().value, 3);
+}
+
+TEST(SmallVectorTest, WorksWithAdapters) {
+  SmallVector<int, 8> vec = {4, 1, 3, 2};
+  EXPECT_EQ(vec | Filter([](int x) { return x > 1; }) | sort(), (SmallVector<int, 8>{2, 3, 4}));
+  EXPECT_EQ(vec | Reverse(), (SmallVector<int, 8>{2, 3, 1, 4}));
+}
+
+TEST(TopKTest, LargestInDescendingOrder) {
+  std::vector<int> vec = {5, 1, 9, 3, 7, 9, 2};
+  auto result = vec | top_k<3>();
+  EXPECT_TRUE(result.is_inline());
+  EXPECT_EQ(result, (SmallVector<int, 3>{9, 9, 7}));
+}
+
+TEST(TopKTest, CustomComparatorAndShortInput) {
+  std::vector<int> vec = {5, 1, 9};
+  EXPECT_EQ(vec | top_k<2>(std::greater<int>()), (SmallVector<int, 2>{1, 5}));
+  EXPECT_EQ(vec | top_k<5>(), (SmallVector<int, 5>{9, 5, 1}));
+  EXPECT_TRUE((vec | top_k<0>()).empty());
+}
+
+TEST(TopKTest, BoundedPipelineUsesInlineStorage) {
+  auto pipeline = Transform([](int x) { return x * 2; }) | take<4>() | Filter([](int x) { return x > 2; });
+  std::vector<int> vec = {1, 2, 3, 4, 5, 6};
+  auto result = vec | pipeline;
+  EXPECT_TRUE(result.is_inline());
+  EXPECT_EQ(result, (SmallVector<int, 4>{4, 6, 8}));
+}
+
+TEST(ShortCircuitTest, StopsAtFirstDecisiveElement) {
+  std::vector<int> vec = {1, 2, 3, 4, 5, 6};
+  int calls = 0;
+  auto counted = Transform([&calls](int x) {
+    ++calls;
+    return x * 10;
+  });
+  EXPECT_TRUE(vec | (counted | any_of([](int x) { return x == 20; })));
+  EXPECT_EQ(calls, 2);
+  calls = 0;
+  EXPECT_FALSE(vec | (counted | all_of([](int x) { return x < 30; })));
+  EXPECT_EQ(calls, 3);
+  calls = 0;
+  EXPECT_EQ(vec | (counted | first()), 10);
+  EXPECT_EQ(calls, 1);
+}
+
+TEST(ShortCircuitTest, FilterThenFirst) {
+  std::vector<int> vec = {1, 3, 4, 5, 6};
+  int checked = 0;
+  auto pipeline = Filter([&checked](int x) {
+    ++checked;
+    return x % 2 == 0;
+  }) | first();
+  EXPECT_EQ(vec | pipeline, 4);
+  EXPECT_EQ(checked, 3);
+  EXPECT_FALSE((std::vector<int>{1, 3} | pipeline).has_value());
+}
+
+TEST(ShortCircuitTest, TerminalAfterEagerLookingStage) {
+  std::vector<int> vec = {1, 3, 4, 5, 6};
+  int checked = 0;
+  auto even = Filter([&checked](int x) {
+    ++checked;
+    return x % 2 == 0;
+  });
+  EXPECT_EQ(vec | even | first(), 4);
+  EXPECT_EQ(checked, 3);
+  checked = 0;
+  EXPECT_TRUE(vec | even | Transform([](int x) { return x * 10; }) | any_of([](int x) { return x == 40; }));
+  EXPECT_EQ(checked, 3);
+  auto evens = vec | even;
+  EXPECT_EQ(evens, (std::vector<int>{4, 6}));
+  EXPECT_EQ(evens.size(), 2u);
+  std::vector<int> copy = evens;
+  EXPECT_EQ(copy, (std::vector<int>{4, 6}));
+}
+
+TEST(ShortCircuitTest, NestedTerminalPipeline) {
+  std::vector<int> vec = {1, 2, 3, 4, 5, 6};
+  int calls = 0;
+  auto pipeline = Filter([](int x) { return x > 2; }) | (Transform([&calls](int x) {
+    ++calls;
+    return x * x;
+  }) | first());
+  EXPECT_EQ(vec | pipeline, 9);
+  EXPECT_EQ(calls, 1);
+  auto counted = Take(5) | (Filter([](int x) { return x % 2; }) | count_if([](int x) { return x > 1; }));
+  EXPECT_EQ(vec | counted, 2u);
+}
+
+TEST(ShortCircuitTest, FindIfAndFirstWhere) {
+  std::vector<std::string> vec = {"apple", "banana", "cherry"};
+  EXPECT_EQ(vec | find_if([](const std::string& s) { return s[0] == 'b'; }), "banana");
+  EXPECT_FALSE((vec | first_where([](const std::string& s) { return s.empty(); })).has_value());
+  auto pipeline = Transform([](const std::string& s) { return s.size(); }) | first_where([](size_t n) { return n > 5; });
+  EXPECT_EQ(vec | pipeline, 6u);
+}
+
+TEST(ShortCircuitTest, PredicatesOnContainers) {
+  std::vector<int> vec = {2, 4, 6};
+  EXPECT_TRUE(vec | all_of([](int x) { return x % 2 == 0; }));
+  EXPECT_TRUE(vec | none_of([](int x) { return x > 10; }));
+  EXPECT_FALSE(vec | any_of([](int x) { return x > 10; }));
+  EXPECT_EQ(vec | count_if([](int x) { return x > 3; }), 2u);
+  std::vector<int> empty;
+  EXPECT_TRUE(empty | all_of([](int) { return false; }));
+  EXPECT_FALSE(empty | any_of([](int) { return true; }));
+}
+
+TEST(ShortCircuitTest, TakeBeforeTerminal) {
+  std::vector<int> vec = {1, 2, 3, 4, 5, 6};
+  EXPECT_EQ(vec | (Take(4) | count_if([](int x) { return x % 2; })), 2u);
+  EXPECT_EQ(vec | (Drop(2) | Take(2) | last()), 4);
+  EXPECT_FALSE((vec | (Take(0) | last())).has_value());
+}
+
+TEST(FilterInTest, DenseIntegers) {
+  std::unordered_set<int> ids = {-3, 2, 5, 7};
+  auto in = filter_in(ids);
+  EXPECT_TRUE(in.membership().is_dense());
+  std::vector<int> vec = {-4, -3, 1, 2, 5, 6, 7, 8};
+  EXPECT_EQ(vec | in, (std::vector<int>{-3, 2, 5, 7}));
+  EXPECT_EQ(vec | filter_not_in(ids), (std::vector<int>{-4, 1, 6, 8}));
+}
+
+TEST(FilterInTest, SparseIntegers) {
+  std::vector<long long> ids = {1, 1LL << 40, -(1LL << 50), 123456789012LL};
+  auto in = filter_in(ids);
+  EXPECT_FALSE(in.membership().is_dense());
+  std::vector<long long> vec;
+  for (long long i = 0; i < 100; ++i) {
+    vec.push_back(i * 1000003);
+  }
+  vec.push_back(1LL << 40);
+  vec.push_back(-(1LL << 50));
+  vec.push_back(1);
+  EXPECT_EQ(vec | in, (std::vector<long long>{1LL << 40, -(1LL << 50), 1}));
+  EXPECT_EQ((vec | filter_not_in(ids)).size(), 100u);
+}
+
+TEST(FilterInTest, Strings) {
+  std::unordered_set<std::string> blacklist = {"spam", "ads"};
+  std::vector<std::string> events = {"login", "spam", "click", "ads", "logout"};
+  EXPECT_EQ(events | filter_not_in(blacklist), (std::vector<std::string>{"login", "click", "logout"}));
+  EXPECT_EQ(events | filter_in(blacklist), (std::vector<std::string>{"spam", "ads"}));
+}
+
+TEST(FilterInTest, EmptySetAndPipeline) {
+  std::vector<int> empty;
+  std::vector<int> vec = {1, 2, 3, 4, 5, 6};
+  EXPECT_TRUE((vec | filter_in(empty)).empty());
+  auto pipeline = Transform([](int x) { return x * 2; }) | filter_in(std::vector<int>{4, 8, 100}) | first();
+  EXPECT_EQ(vec | pipeline, 4);
+}
+
+TEST(FilterInTest, LargeSetMatchesUnorderedSet) {
+  std::unordered_set<unsigned> ids;
+  for (unsigned i = 0; i < 5000; ++i) {
+    ids.insert(i * 2654435761u);
+  }
+  std::vector<unsigned> vec;
+  for (unsigned i = 0; i < 20000; ++i) {
+    vec.push_back(i % 3 == 0 ? i * 2654435761u : i * 40503u + 7);
+  }
+  auto expected = vec | Filter([&ids](unsigned x) { return ids.count(x) > 0; });
+  EXPECT_EQ(vec | filter_in(ids), expected);
+}
+
+TEST(MergeTest, KWayMerge) {
+  std::vector<std::vector<int>> shards = {{1, 4, 9}, {2, 3, 10}, {}, {0, 5}, {6, 7, 8}};
+  EXPECT_EQ(shards | merge(), (std::vector<int>{0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10}));
+}
+
+TEST(MergeTest, SingleAndEmptyInputs) {
+  std::vector<std::vector<int>> single = {{1, 2, 3}};
+  std::vector<std::vector<int>> none;
+  std::vector<std::vector<int>> empty = {{}, {}};
+  EXPECT_EQ(single | merge(), (std::vector<int>{1, 2, 3}));
+  EXPECT_TRUE((none | merge()).empty());
+  EXPECT_TRUE((empty | merge()).empty());
+}
+
+TEST(MergeTest, StableAndCustomComparator) {
+  using Item = std::pair<int, char>;
+  std::vector<std::vector<Item>> shards = {{{3, 'a'}, {1, 'a'}}, {{3, 'b'}, {2, 'b'}}, {{1, 'c'}}};
+  auto by_key = [](const Item& lhs, const Item& rhs) { return lhs.first > rhs.first; };
+  EXPECT_EQ(shards | merge(by_key), (std::vector<Item>{{3, 'a'}, {3, 'b'}, {2, 'b'}, {1, 'a'}, {1, 'c'}}));
+}
+
+TEST(MergeTest, LazyInPipeline) {
+  std::vector<std::vector<int>> shards;
+  for (int s = 0; s < 64; ++s) {
+    std::vector<int> shard;
+    for (int i = 0; i < 100; ++i) {
+      shard.push_back(i * 64 + s);
+    }
+    shards.push_back(shard);
+  }
+  EXPECT_EQ(shards | (merge() | Filter([](int x) { return x % 2; }) | Take(3)), (std::vector<int>{1, 3, 5}));
+  EXPECT_EQ(shards | (merge() | first_where([](int x) { return x > 100; })), 101);
+  auto merged = shards | merge();
+  EXPECT_EQ(merged.size(), 6400u);
+  EXPECT_TRUE(std::is_sorted(merged.begin(), merged.end()));
+}
+
+TEST(SetAlgebraTest, SortedInputs) {
+  std::vector<int> lhs = {1, 2, 2, 4, 6};
+  std::vector<int> rhs = {2, 3, 4, 4};
+  EXPECT_EQ(lhs | set_union(rhs), (std::vector<int>{1, 2, 2, 3, 4, 4, 6}));
+  EXPECT_EQ(lhs | set_difference(rhs), (std::vector<int>{1, 2, 6}));
+  EXPECT_EQ(lhs | symmetric_difference(rhs), (std::vector<int>{1, 2, 3, 4, 6}));
+}
+
+TEST(SetAlgebraTest, UnsortedInputs) {
+  std::vector<int> lhs = {6, 2, 1, 2, 4};
+  std::vector<int> rhs = {4, 3, 4, 2};
+  EXPECT_EQ(lhs | set_union(rhs), (std::vector<int>{6, 2, 1, 2, 4, 4, 3}));
+  EXPECT_EQ(lhs | set_difference(rhs), (std::vector<int>{6, 1, 2}));
+  EXPECT_EQ(lhs | symmetric_difference(rhs), (std::vector<int>{6, 1, 2, 4, 3}));
+}
+
+TEST(SetAlgebraTest, DescendingComparatorAndEmpty) {
+  std::vector<int> lhs = {9, 5, 1};
+  std::vector<int> rhs = {7, 5};
+  std::vector<int> empty;
+  EXPECT_EQ(lhs | set_union(rhs, std::greater<int>()), (std::vector<int>{9, 7, 5, 1}));
+  EXPECT_EQ(lhs | set_difference(empty), lhs);
+  EXPECT_EQ(empty | symmetric_difference(rhs), rhs);
+}
+
+TEST(ColumnTableTest, WhereAndColumn) {
+  ColumnTable<int, std::string, double> table;
+  table.push_back(1, "a", 1.5);
+  table.push_back(2, "b", 2.5);
+  table.push_back(3, "c", 3.5);
+  table.push_back(4, "d", 4.5);
+  auto selected = table | where<0>([](int id) { return id % 2 == 0; });
+  EXPECT_EQ(selected.size(), 2u);
+  EXPECT_EQ(selected.selection(), (std::vector<size_t>{1, 3}));
+  EXPECT_EQ(selected | column<1>(), (std::vector<std::string>{"b", "d"}));
+  EXPECT_EQ(table | column<0>(), (std::vector<int>{1, 2, 3, 4}));
+}
+
+TEST(ColumnTableTest, ChainedFiltersAndAggregates) {
+  ColumnTable<int, double> table({5, 3, 8, 1, 9}, {0.5, 0.3, 0.8, 0.1, 0.9});
+  auto result = table
+      | where<0>([](int x) { return x > 2; })
+      | where<1>([](double x) { return x < 0.85; })
+      | column<0>()
+      | Transform([](int x) { return x * 10; })
+      | max_element(std::less<int>());
+  EXPECT_EQ(result, 80);
+}
+
+TEST(ColumnTableTest, OrderByAndRows) {
+  ColumnTable<std::string, int> table({"x", "y", "z", "w"}, {3, 1, 2, 1});
+  auto ordered = table | order_by<1>();
+  EXPECT_EQ(ordered | column<0>(), (std::vector<std::string>{"y", "w", "z", "x"}));
+  auto rows_desc = table
+      | where<1>([](int x) { return x > 1; })
+      | order_by<1>(std::greater<int>())
+      | rows();
+  std::vector<std::tuple<std::string, int>> expected = {{"x", 3}, {"z", 2}};
+  EXPECT_EQ(rows_desc, expected);
+}
+
+TEST(ColumnTableTest, EmptyTable) {
+  ColumnTable<int, int> table;
+  EXPECT_TRUE(table.empty());
+  EXPECT_TRUE((table | where<0>([](int) { return true; })).empty());
+  EXPECT_TRUE((table | rows()).empty());
+}
+
+TEST(ColumnTableTest, RejectsColumnsOfDifferentLengths) {
+  EXPECT_THROW((ColumnTable<int, double>({1, 2, 3}, {0.5})), std::invalid_argument);
+  EXPECT_THROW((ColumnTable<int, double, char>({1}, {0.5}, {})), std::invalid_argument);
+  ColumnTable<int, double> table({1, 2}, {0.5, 1.5});
+  EXPECT_EQ(table.size(), 2u);
+}
+
+TEST(CacheTest, SecondTraversalReadsBuffer) {
+  std::vector<int> vec = {4, 1, 7, 3, 8, 2};
+  int calls = 0;
+  auto pipeline = Filter([](int x) { return x > 1; })
+      | Transform([&calls](int x) {
+          ++calls;
+          return x * 10;
+        })
+      | cache();
+  auto cached = vec | pipeline;
+  EXPECT_EQ(calls, 0);
+  EXPECT_EQ(cached | max_element(std::less<int>()), 80);
+  EXPECT_EQ(calls, 5);
+  EXPECT_EQ(cached | min_element(std::less<int>()), 20);
+  EXPECT_EQ(cached | sort(), (std::vector<int>{20, 30, 40, 70, 80}));
+  EXPECT_EQ(calls, 5);
+}
+
+TEST(CacheTest, PartialTraversalFillsPrefix) {
+  std::vector<int> vec = {1, 2, 3, 4, 5, 6, 7, 8};
+  int calls = 0;
+  auto cached = vec | (Transform([&calls](int x) {
+    ++calls;
+    return x * x;
+  }) | cache());
+  EXPECT_EQ(cached | first(), 1);
+  EXPECT_EQ(calls, 1);
+  EXPECT_EQ(cached | (Take(3) | last()), 9);
+  EXPECT_EQ(calls, 3);
+  EXPECT_FALSE(cached.is_complete());
+  EXPECT_EQ(cached.cached_size(), 3u);
+  EXPECT_EQ(cached | Reverse(), (std::vector<int>{64, 49, 36, 25, 16, 9, 4, 1}));
+  EXPECT_EQ(calls, 8);
+  EXPECT_TRUE(cached.is_complete());
+}
+
+TEST(CacheTest, TakeStopsReadingInput) {
+  std::vector<int> vec = {1, 2, 3, 4, 5, 6};
+  int calls = 0;
+  auto cached = vec | (Transform([&calls](int x) {
+    ++calls;
+    return x;
+  }) | Take(2) | cache());
+  EXPECT_EQ(cached | Filter([](int x) { return x > 0; }), (std::vector<int>{1, 2}));
+  EXPECT_EQ(cached.size(), 2u);
+  EXPECT_EQ(calls, 2);
+}
+
+TEST(CacheTest, ReferencesSurviveLaterFill) {
+  std::vector<int> vec;
+  for (int i = 0; i < 10000; ++i) {
+    vec.push_back(i);
+  }
+  auto cached = vec | (Transform([](int x) { return x * 3; }) | cache());
+  const int& front = cached.front();
+  auto it = cached.begin();
+  const int& first = *it;
+  const int& second = cached[1];
+  EXPECT_EQ(cached.size(), 10000u);
+  EXPECT_EQ(front, 0);
+  EXPECT_EQ(first, 0);
+  EXPECT_EQ(second, 3);
+  EXPECT_EQ(&*it, &cached.front());
+}
+
+TEST(CacheTest, MergeSourceAndPlainContainer) {
+  std::vector<std::vector<int>> shards = {{1, 5}, {2, 3}};
+  auto cached = shards | (merge() | cache());
+  EXPECT_EQ(cached | Transform([](int x) { return x + 1; }), (std::vector<int>{2, 3, 4, 6}));
+  std::vector<int> vec = {3, 1};
+  EXPECT_EQ(vec | cache(), vec);
+  std::vector<int> empty;
+  EXPECT_TRUE((empty | (Filter([](int) { return true; }) | cache())).empty());
+}
+
+TEST(CacheTest, OwnsIntermediateInput) {
+  std::vector<int> vec = {1, 2, 3, 4, 5, 6};
+  auto is_odd = [](int x) { return x % 2 == 1; };
+  auto square = [](int x) { return x * x; };
+  auto after_stage = vec | Filter(is_odd) | (Transform(square) | cache());
+  auto nested = vec | (Filter(is_odd) | (Transform(square) | cache()));
+  auto from_temporary = std::vector<int>{3, 2, 1} | (Transform(square) | cache());
+  EXPECT_EQ(after_stage | Collect(), (std::vector<int>{1, 9, 25}));
+  EXPECT_EQ(nested | Collect(), (std::vector<int>{1, 9, 25}));
+  EXPECT_EQ(from_temporary | Collect(), (std::vector<int>{9, 4, 1}));
+}
+
+TEST(IncrementalTest, ProcessesOnlyAppendedElements) {
+  std::vector<int> events = {5, 3, 8};
+  int calls = 0;
+  auto pipeline = Filter([](int x) { return x > 2; })
+      | Transform([&calls](int x) {
+          ++calls;
+          return x % 10;
+        })
+      | distinct()
+      | max_element(std::less<int>());
+  auto live = events | incremental(pipeline);
+  EXPECT_EQ(live.result(), 8);
+  EXPECT_EQ(calls, 3);
+  events.push_back(1);
+  events.push_back(19);
+  events.push_back(13);
+  EXPECT_EQ(live.refresh(), 9);
+  EXPECT_EQ(calls, 5);
+  EXPECT_EQ(live.consumed(), 6u);
+}
+
+TEST(IncrementalTest, StreamingChainKeepsState) {
+  std::vector<int> events = {1, 2, 2, 3};
+  auto live = events | incremental(distinct() | Drop(1) | Take(3));
+  EXPECT_EQ(live.result(), (std::vector<int>{2, 3}));
+  events.push_back(3);
+  events.push_back(4);
+  events.push_back(5);
+  events.push_back(6);
+  EXPECT_EQ(live.refresh(), (std::vector<int>{2, 3, 4}));
+}
+
+TEST(IncrementalTest, TerminalsKeepState) {
+  std::vector<int> events = {4, 9, 1};
+  auto top = events | incremental(top_k<2>());
+  auto count = events | incremental(count_if([](int x) { return x % 2; }));
+  auto minimum = events | incremental(Transform([](int x) { return -x; }) | min_element(std::less<int>()));
+  events.push_back(7);
+  events.push_back(10);
+  EXPECT_EQ(top.refresh(), (SmallVector<int, 2>{10, 9}));
+  EXPECT_EQ(count.refresh(), 3u);
+  EXPECT_EQ(minimum.refresh(), -10);
+}
+
+TEST(IncrementalTest, EmptyAndShrinkingSource) {
+  std::vector<int> events;
+  auto live = events | incremental(max_element(std::less<int>()));
+  EXPECT_THROW(live.result(), std::out_of_range);
+  events.push_back(3);
+  EXPECT_EQ(live.refresh(), 3);
+  events.clear();
+  EXPECT_THROW(live.refresh(), std::logic_error);
+}
+
+TEST(StreamingTest, DistinctAndMaxInPipeline) {
+  std::vector<int> vec = {3, 1, 3, 2, 1};
+  EXPECT_EQ(vec | (distinct() | Take(2)), (std::vector<int>{3, 1}));
+  EXPECT_EQ(vec | (Filter([](int x) { return x < 3; }) | max_element(std::less<int>())), 2);
+}
+
+TEST(SamplingTest, ReservoirKeepsKDistinctInputElements) {
+  std::vector<int> vec(1000);
+  for (int i = 0; i < 1000; ++i) {
+    vec[i] = i;
+  }
+  auto sample = vec | sample_reservoir(10, 42);
+  EXPECT_EQ(sample.size(), 10u);
+  EXPECT_EQ((sample | distinct()).size(), 10u);
+  EXPECT_EQ(sample, vec | sample_reservoir(10, 42));
+  EXPECT_EQ((std::vector<int>{1, 2} | sample_reservoir(5, 1)), (std::vector<int>{1, 2}));
+  EXPECT_TRUE((vec | sample_reservoir(0, 1)).empty());
+}
+
+TEST(SamplingTest, ReservoirIsRoughlyUniform) {
+  std::vector<int> vec(100);
+  for (int i = 0; i < 100; ++i) {
+    vec[i] = i;
+  }
+  std::vector<int> hits(100);
+  for (uint64_t seed = 0; seed < 2000; ++seed) {
+    for (int x : vec | sample_reservoir(5, seed)) {
+      ++hits[x];
+    }
+  }
+  // Ожидается 100 попаданий на элемент
+  EXPECT_GT(hits | min_element(std::less<int>()), 50);
+  EXPECT_LT(hits | max_element(std::less<int>()), 150);
+}
+
+TEST(SamplingTest, BernoulliRate) {
+  std::vector<int> vec(100000, 1);
+  auto sample = vec | sample_bernoulli(0.01, 7);
+  EXPECT_GT(sample.size(), 800u);
+  EXPECT_LT(sample.size(), 1200u);
+  EXPECT_EQ((vec | sample_bernoulli(1.0, 7)).size(), vec.size());
+  EXPECT_TRUE((vec | sample_bernoulli(0.0, 7)).empty());
+}
+
+TEST(SamplingTest, BernoulliStreamingMatchesRandomAccess) {
+  std::vector<int> vec(5000);
+  for (int i = 0; i < 5000; ++i) {
+    vec[i] = i;
+  }
+  auto direct = vec | sample_bernoulli(0.05, 3);
+  auto streamed = vec | (PassThrough() | sample_bernoulli(0.05, 3));
+  EXPECT_EQ(direct, streamed);
+  EXPECT_TRUE(std::is_sorted(direct.begin(), direct.end()));
+}
+
+TEST(SamplingTest, StratifiedPerKey) {
+  std::vector<int> vec;
+  for (int i = 0; i < 300; ++i) {
+    vec.push_back(i);
+  }
+  vec.push_back(1001);
+  auto sample = vec | sample_stratified([](int x) { return x % 3; }, 4, 11);
+  EXPECT_EQ(sample.size(), 12u);
+  for (size_t i = 0; i < sample.size(); ++i) {
+    EXPECT_EQ(sample[i] % 3, static_cast<int>(i / 4));
+  }
+}
+
+TEST(SketchTest, ApproxDistinctCount) {
+  std::vector<int> vec;
+  for (int i = 0; i < 200000; ++i) {
+    vec.push_back(i % 50000);
+  }
+  auto estimate = vec | approx_distinct_count(14);
+  EXPECT_NEAR(static_cast<double>(estimate), 50000.0, 50000.0 * 0.03);
+  EXPECT_EQ(std::vector<int>{} | approx_distinct_count(), 0u);
+  EXPECT_EQ((std::vector<int>{7, 7, 7} | approx_distinct_count()), 1u);
+}
+
+TEST(SketchTest, HyperLogLogMergeAcrossChunks) {
+  std::vector<int> lhs;
+  std::vector<int> rhs;
+  for (int i = 0; i < 30000; ++i) {
+    lhs.push_back(i);
+    rhs.push_back(i + 15000);
+  }
+  auto sketch = lhs | hll_sketch(12);
+  sketch.merge(rhs | hll_sketch(12));
+  EXPECT_NEAR(sketch.estimate(), 45000.0, 45000.0 * 0.05);
+  EXPECT_THROW(sketch.merge(rhs | hll_sketch(10)), std::invalid_argument);
+  EXPECT_THROW(lhs | hll_sketch(30), std::invalid_argument);
+}
+
+TEST(SketchTest, ApproxQuantiles) {
+  std::vector<int> vec;
+  for (int i = 0; i < 100000; ++i) {
+    vec.push_back((i * 7919) % 100000);
+  }
+  auto quantiles = vec | approx_quantiles({0.0, 0.5, 0.99, 1.0});
+  EXPECT_EQ(quantiles.size(), 4u);
+  EXPECT_LE(quantiles[0], 2000);
+  EXPECT_NEAR(quantiles[1], 50000, 2000);
+  EXPECT_NEAR(quantiles[2], 99000, 2000);
+  EXPECT_GE(quantiles[3], 98000);
+  EXPECT_THROW(std::vector<int>{} | approx_quantiles({0.5}), std::out_of_range);
+}
+
+TEST(SketchTest, KllMergeAndSmallInput) {
+  std::vector<double> small = {3.0, 1.0, 2.0};
+  EXPECT_EQ(small | approx_quantiles({0.0, 0.5, 1.0}), (std::vector<double>{1.0, 2.0, 3.0}));
+  std::vector<int> lhs;
+  std::vector<int> rhs;
+  for (int i = 0; i < 50000; ++i) {
+    lhs.push_back(i);
+    rhs.push_back(50000 + i);
+  }
+  auto sketch = lhs | kll_sketch(200);
+  sketch.merge(rhs | kll_sketch(200));
+  EXPECT_EQ(sketch.size(), 100000u);
+  EXPECT_NEAR(sketch.quantile(0.5), 50000, 2000);
+  EXPECT_NEAR(sketch.quantile(0.25), 25000, 2000);
+}
+
+TEST(ExternalSortTest, SpillsRunsAndMerges) {
+  std::vector<int> vec;
+  for (int i = 0; i < 5000; ++i) {
+    vec.push_back((i * 7919) % 5003);
+  }
+  auto expected = vec | sort();
+  // 64 байта - серии по 16 элементов
+  EXPECT_EQ(vec | sort().with_memory_budget(64), expected);
+  EXPECT_EQ(vec | sort(std::greater<>()).with_memory_budget(1000), vec | sort(std::greater<>()));
+  EXPECT_EQ(vec | sort().with_memory_budget(1), expected);
+}
+
+#if __has_include(<sys/resource.h>)
+TEST(ExternalSortTest, ManyRunsUnderLowFileLimit) {
+  rlimit saved;
+  ASSERT_EQ(getrlimit(RLIMIT_NOFILE, &saved), 0);
+  rlimit lowered = saved;
+  lowered.rlim_cur = std::min<rlim_t>(saved.rlim_cur, 128);
+  ASSERT_EQ(setrlimit(RLIMIT_NOFILE, &lowered), 0);
+
+  std::vector<int> vec;
+  for (int i = 0; i < 40000; ++i) {
+    vec.push_back((i * 7919) % 40009);
+  }
+  // Серии по одному элементу: 40000 серий при лимите в 128 файлов
+  auto sorted = vec | sort().with_memory_budget(1);
+  auto streamed = vec | (sort().with_memory_budget(16) | Take(5));
+  setrlimit(RLIMIT_NOFILE, &saved);
+  auto expected = vec | sort();
+  EXPECT_EQ(sorted, expected);
+  EXPECT_EQ(streamed, std::vector<int>(expected.begin(), expected.begin() + 5));
+}
+#endif
+
+TEST(ExternalSortTest, FitsInMemoryAndEmpty) {
+  std::vector<double> vec = {3.5, -1.0, 2.25};
+  EXPECT_EQ(vec | sort().with_memory_budget(1 << 20), (std::vector<double>{-1.0, 2.25, 3.5}));
+  EXPECT_TRUE((std::vector<int>{} | sort().with_memory_budget(64)).empty());
+}
+
+TEST(ExternalSortTest, StreamsIntoPipeline) {
+  std::vector<int> vec;
+  for (int i = 0; i < 10000; ++i) {
+    vec.push_back(10000 - i);
+  }
+  auto smallest = vec | (sort().with_memory_budget(256) | Filter([](int x) { return x % 3 == 0; }) | Take(3));
+  EXPECT_EQ(smallest, (std::vector<int>{3, 6, 9}));
+  EXPECT_EQ(vec | (sort().with_memory_budget(256) | first_where([](int x) { return x > 500; })), 501);
+}
+
+TEST(AdaptiveSortTest, MatchesStableSort) {
+  std::mt19937 rng(7);
+  for (size_t n : {0u, 1u, 2u, 31u, 33u, 100u, 5000u}) {
+    std::vector<std::pair<int, int>> vec;
+    for (size_t i = 0; i < n; ++i) {
+      vec.emplace_back(static_cast<int>(rng() % 50), static_cast<int>(i));
+    }
+    auto by_key = [](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; };
+    auto expected = vec;
+    std::stable_sort(expected.begin(), expected.end(), by_key);
+    EXPECT_EQ(vec | adaptive_sort(by_key), expected);
+    EXPECT_EQ(vec | sort(by_key).adaptive(), expected);
+  }
+}
+
+TEST(AdaptiveSortTest, PresortedInputIsLinear) {
+  std::vector<int> ascending(10000);
+  for (int i = 0; i < 10000; ++i) {
+    ascending[i] = i;
+  }
+  std::vector<int> descending(ascending.rbegin(), ascending.rend());
+  size_t comparisons = 0;
+  auto counting = [&comparisons](int lhs, int rhs) {
+    ++comparisons;
+
+    return lhs < rhs;
+  };
+  EXPECT_EQ(ascending | adaptive_sort(counting), ascending);
+  EXPECT_EQ(comparisons, ascending.size() - 1);
+  comparisons = 0;
+  EXPECT_EQ(descending | adaptive_sort(counting), ascending);
+  EXPECT_EQ(comparisons, ascending.size() - 1);
+}
+
+TEST(AdaptiveSortTest, AppendedBatchesAndLocalDisorder) {
+  std::vector<int> vec;
+  for (int batch = 0; batch < 8; ++batch) {
+    for (int i = 0; i < 1000; ++i) {
+      vec.push_back(i * 8 + batch);
+    }
+  }
+  for (size_t i = 0; i + 1 < vec.size(); i += 97) {
+    std::swap(vec[i], vec[i + 1]);
+  }
+  EXPECT_EQ(vec | sort().adaptive(), vec | sort());
+  EXPECT_EQ(vec | adaptive_sort(std::greater<>()), vec | sort(std::greater<>()));
+}
+
+TEST(TokenizeTest, SplitKeepsEmptyFields) {
+  std::string text = "a,,bc,";
+  auto fields = text | split(',');
+  EXPECT_EQ(fields, (std::vector<std::string_view>{"a", "", "bc", ""}));
+  EXPECT_EQ(fields[2].data(), text.data() + 3);
+  EXPECT_EQ(std::string() | split(','), (std::vector<std::string_view>{""}));
+  EXPECT_EQ(std::string_view("abc") | split(','), (std::vector<std::string_view>{"abc"}));
+}
+
+TEST(TokenizeTest, SplitAnySkipsEmptyWords) {
+  std::string text = "  to be,\tor  not ";
+  EXPECT_EQ(text | split_any(" ,\t"), (std::vector<std::string_view>{"to", "be", "or", "not"}));
+  EXPECT_EQ(text | split_any(" "), (std::vector<std::string_view>{"to", "be,\tor", "not"}));
+  EXPECT_TRUE((std::string(" \t ") | split_any(" \t")).empty());
+}
+
+TEST(TokenizeTest, LinesAndTrim) {
+  std::string text = "first\r\n  second \n\nlast\n";
+  EXPECT_EQ(text | lines(), (std::vector<std::string_view>{"first", "  second ", "", "last"}));
+  EXPECT_EQ(text | (lines() | trim()), (std::vector<std::string_view>{"first", "second", "", "last"}));
+  EXPECT_EQ(std::string("no newline") | lines(), (std::vector<std::string_view>{"no newline"}));
+  EXPECT_TRUE((std::string() | lines()).empty());
+  EXPECT_EQ(std::string(" \t padded\n") | trim(), std::string_view("padded"));
+  EXPECT_EQ(std::string("xxyxx") | trim("x"), std::string_view("y"));
+  EXPECT_EQ(std::string("   ") | trim(), std::string_view());
+}
+
+TEST(TokenizeTest, TrimOwnsTransformedStrings) {
+  std::vector<std::string> words = {" ab ", "cd  "};
+  auto to_upper = [](const std::string& word) {
+    std::string upper = word;
+    for (char& c : upper) {
+      c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    }
+
+    return upper + std::string(32, ' ');
+  };
+  auto trimmed = words | (Transform(to_upper) | trim());
+  EXPECT_EQ(trimmed, (std::vector<std::string>{"AB", "CD"}));
+  EXPECT_EQ(words | Transform(to_upper) | trim(), (std::vector<std::string>{"AB", "CD"}));
+  EXPECT_EQ(words | trim(), (std::vector<std::string>{"ab", "cd"}));
+}
+
+TEST(TokenizeTest, ComposesWithOtherStages) {
+  std::string log = "GET /a 200\nPOST /b 500\nGET /c 200\n\nGET /a 404\n";
+  auto methods = log | (lines() | Filter([](std::string_view line) { return !line.empty(); })
+                        | Transform([](std::string_view line) { return line.substr(0, line.find(' ')); }) | distinct());
+  EXPECT_EQ(methods, (std::vector<std::string_view>{"GET", "POST"}));
+
+  auto words = log | (split_any(" \n") | count_by());
+  EXPECT_EQ(words.size(), 8u);
+  EXPECT_EQ(words["GET"], 3u);
+  EXPECT_EQ(words["200"], 2u);
+
+  auto by_length = log | (split_any(" \n") | count_by([](std::string_view word) { return word.size(); }));
+  EXPECT_EQ(by_length[3], 7u);
+  EXPECT_EQ(std::string("a,b,,c") | (split(',') | Filter([](std::string_view f) { return !f.empty(); }) | Take(2)),
+            (std::vector<std::string_view>{"a", "b"}));
+}
+
+#ifdef ADAPTERS_HAS_PROCESSES
+TEST(ProcessTest, MatchesInProcessResult) {
+  std::vector<int> vec;
+  for (int i = 0; i < 100003; ++i) {
+    vec.push_back(i);
+  }
+  auto chain = Filter([](int x) { return x % 3 != 0; }) | Transform([](int x) { return x * 0.5; });
+  EXPECT_EQ(vec | in_processes(chain, 4), vec | chain);
+  EXPECT_EQ(vec | in_processes(chain, 1), vec | chain);
+  EXPECT_TRUE((std::vector<int>{} | in_processes(chain, 4)).empty());
+}
+
+TEST(ProcessTest, RunsInSeparateProcesses) {
+  std::vector<int> vec(64, 0);
+  auto pids = vec | in_processes(Transform([](int) { return getpid(); }), 4);
+  std::unordered_set<pid_t> distinct_pids(pids.begin(), pids.end());
+  EXPECT_EQ(distinct_pids.size(), 4u);
+  EXPECT_EQ(distinct_pids.count(getpid()), 0u);
+  std::vector<int> short_input = {1, 2};
+  EXPECT_EQ(short_input | in_processes(Transform([](int x) { return x + 1; }), 8), (std::vector<int>{2, 3}));
+}
+
+TEST(ProcessTest, WorkerFailureIsReported) {
+  std::vector<int> vec = {1, 2, 3, 4};
+  auto throwing = Transform([](int x) {
+    if (x == 3) throw std::runtime_error("bad element");
+
+    return x;
+  });
+  EXPECT_THROW(vec | in_processes(throwing, 2), std::runtime_error);
+}
+#endif
+
+struct Sample {
+  long long ts;
+  double value;
+};
+
+TEST(WindowTest, TumblingWindows) {
+  std::vector<Sample> samples = {{0, 1.0}, {3, 5.0}, {9, -2.0}, {10, 4.0}, {35, 7.0}, {39, 1.0}};
+  auto windows = samples | tumbling_window([](const Sample& s) { return s.ts; }, 10LL,
+                                           [](const Sample& s) { return s.value; });
+  using Stats = WindowStats<long long, double>;
+  EXPECT_EQ(windows, (std::vector<Stats>{{0, 10, 3, 4.0, -2.0, 5.0}, {10, 20, 1, 4.0, 4.0, 4.0}, {30, 40, 2, 8.0, 1.0, 7.0}}));
+  EXPECT_TRUE((std::vector<Sample>{} | tumbling_window([](const Sample& s) { return s.ts; }, 10LL,
+                                                      [](const Sample& s) { return s.value; })).empty());
+}
+
+TEST(WindowTest, SlidingWindowsMatchBruteForce) {
+  std::mt19937 rng(11);
+  std::vector<std::pair<int, int>> samples;
+  int ts = -50;
+  for (int i = 0; i < 3000; ++i) {
+    ts += static_cast<int>(rng() % 4 == 0 ? rng() % 40 : rng() % 2);
+    samples.emplace_back(ts, static_cast<int>(rng() % 1000) - 500);
+  }
+  auto ts_of = [](const std::pair<int, int>& s) { return s.first; };
+  auto value_of = [](const std::pair<int, int>& s) { return s.second; };
+  for (auto [width, step] : {std::pair{60, 10}, std::pair{10, 10}, std::pair{7, 3}, std::pair{5, 20}}) {
+    std::vector<WindowStats<int, int>> expected;
+    int first = (samples.front().first - width) / step * step - step;
+    for (int start = first; start <= samples.back().first; start += step) {
+      auto values = samples | (Filter([&](const auto& s) { return s.first >= start && s.first < start + width; })
+                               | Transform(value_of));
+      if (values.empty()) continue;
+      int sum = 0;
+      for (int v : values) {
+        sum += v;
+      }
+      expected.push_back({start, start + width, values.size(), sum, *std::min_element(values.begin(), values.end()),
+                          *std::max_element(values.begin(), values.end())});
+    }
+    EXPECT_EQ(samples | sliding_window_by_time(ts_of, width, step, value_of), expected);
+  }
+}
+
+TEST(WindowTest, StreamsAndValidates) {
+  std::vector<int> timestamps;
+  for (int i = 0; i < 100000; ++i) {
+    timestamps.push_back(i);
+  }
+  auto identity_ts = [](int ts) { return ts; };
+  auto busy = timestamps | (sliding_window_by_time(identity_ts, 1000, 100) | Take(2));
+  EXPECT_EQ(busy.size(), 2u);
+  EXPECT_EQ(busy[0].start, -900);
+  EXPECT_EQ(busy[0].count, 100u);
+  EXPECT_EQ(busy[1].max, 199);
+  EXPECT_THROW(timestamps | tumbling_window(identity_ts, 0), std::invalid_argument);
+  EXPECT_THROW((std::vector<int>{3, 1} | tumbling_window(identity_ts, 10)), std::invalid_argument);
+}
+
+TEST(WindowTest, UnsignedAndChronoTimestamps) {
+  auto identity_ts = [](uint32_t ts) { return ts; };
+  std::vector<uint32_t> small = {1, 2, 12};
+  auto tumbling = small | tumbling_window(identity_ts, 10u);
+  ASSERT_EQ(tumbling.size(), 2u);
+  EXPECT_EQ(tumbling[0].start, 0u);
+  EXPECT_EQ(tumbling[0].count, 2u);
+  EXPECT_EQ(tumbling[1].start, 10u);
+  auto sliding = small | sliding_window_by_time(identity_ts, 10u, 5u);
+  ASSERT_EQ(sliding.size(), 3u);
+  EXPECT_EQ(sliding[0].start, 0u);
+  EXPECT_EQ(sliding[0].count, 2u);
+  EXPECT_EQ(sliding[1].start, 5u);
+  EXPECT_EQ(sliding[1].count, 1u);
+
+  using namespace std::chrono;
+  struct Event {
+    sys_time<milliseconds> at;
+    double value;
+  };
+  sys_time<milliseconds> epoch{};
+  std::vector<Event> events = {{epoch + 200ms, 1.0}, {epoch + 900ms, 2.0}, {epoch + 1500ms, 4.0}};
+  auto per_second = events | tumbling_window([](const Event& e) { return e.at; }, seconds(1),
+                                             [](const Event& e) { return e.value; });
+  ASSERT_EQ(per_second.size(), 2u);
+  EXPECT_EQ(per_second[0].start, epoch);
+  EXPECT_EQ(per_second[0].end, epoch + 1s);
+  EXPECT_EQ(per_second[0].sum, 3.0);
+  EXPECT_EQ(per_second[1].max, 4.0);
+  auto too_fine = tumbling_window([](const Event& e) { return e.at; }, microseconds(10),
+                                  [](const Event& e) { return e.value; });
+  EXPECT_THROW((events | too_fine).size(), std::invalid_argument);
+}
+
+TEST(RuntimePipelineTest, BuildsFromSpec) {
+  std::vector<int> vec;
+  for (int i = 0; i < 5000; ++i) {
+    vec.push_back(i % 1500);
+  }
+  RuntimeStageRegistry<int> registry;
+  auto pipeline = registry.build("filter gt 10 | transform mul 3 | distinct | drop 2 | take 2000");
+  auto expected = vec | (Filter([](int x) { return x > 10; }) | Transform([](int x) { return x * 3; }) | distinct()
+                         | Drop(2) | Take(2000));
+  EXPECT_EQ(pipeline.size(), 5u);
+  EXPECT_EQ(vec | pipeline, expected);
+  // Состояние стадий не переносится между запусками
+  EXPECT_EQ(vec | pipeline, expected);
+  std::deque<int> deque(vec.begin(), vec.end());
+  EXPECT_EQ(deque | pipeline, expected);
+}
+
+TEST(RuntimePipelineTest, StopsEarlyAndReusesResult) {
+  std::vector<double> vec(100000, 1.5);
+  RuntimeStageRegistry<double> registry;
+  auto pipeline = registry.build("transform add 0.5 | take 3");
+  std::vector<double> result;
+  pipeline.run(vec, result);
+  EXPECT_EQ(result, (std::vector<double>{2.0, 2.0, 2.0}));
+  EXPECT_TRUE((std::vector<double>{} | pipeline).empty());
+  EXPECT_EQ(vec | RuntimePipeline<double>(), vec);
+}
+
+TEST(RuntimePipelineTest, CustomStagesAndErrors) {
+  RuntimeStageRegistry<int> registry;
+  registry.add_adapter("odd", Filter([](int x) { return x % 2 != 0; }));
+  registry.add("clamp", [](const auto& args) {
+    int limit = std::stoi(std::string(args.at(0)));
+
+    return make_runtime_stage<int>(Transform([limit](int x) { return std::min(x, limit); }));
+  });
+  std::vector<int> vec = {1, 2, 3, 5, 8, 13};
+  EXPECT_EQ(vec | registry.build("odd | clamp 6"), (std::vector<int>{1, 3, 5, 6}));
+  EXPECT_THROW(registry.build("unknown"), std::invalid_argument);
+  EXPECT_THROW(registry.build("filter gt"), std::invalid_argument);
+  EXPECT_THROW(registry.build("filter approx 3"), std::invalid_argument);
+  EXPECT_THROW(registry.build("take ten"), std::invalid_argument);
+  EXPECT_THROW(registry.build("odd || take 1"), std::invalid_argument);
+}
+
+TEST(GatherTest, GatherAndPermute) {
+  std::vector<std::string> names = {"zero", "one", "two", "three"};
+  std::vector<size_t> indices = {3, 0, 3, 1};
+  EXPECT_EQ(indices | gather(names), (std::vector<std::string>{"three", "zero", "three", "one"}));
+  EXPECT_EQ(names | permute(std::vector<int>{2, 1, 0}, 1), (std::vector<std::string>{"two", "one", "zero"}));
+  EXPECT_TRUE((std::vector<size_t>{} | gather(names)).empty());
+  EXPECT_THROW(std::vector<size_t>{4} | gather(names), std::out_of_range);
+}
+
+TEST(GatherTest, SortIndicesThenFetch) {
+  std::mt19937 rng(3);
+  std::vector<int> data(100000);
+  for (auto& x : data) {
+    x = static_cast<int>(rng() % 1000000);
+  }
+  std::vector<size_t> order(data.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), [&data](size_t lhs, size_t rhs) { return data[lhs] < data[rhs]; });
+  EXPECT_EQ(data | permute(order, 32), data | sort());
+  EXPECT_EQ(order | (gather(data) | Filter([](int x) { return x % 2 == 0; }) | Take(3)),
+            (data | sort() | Filter([](int x) { return x % 2 == 0; }) | Take(3)));
+}
+
+TEST(GatherTest, BatchedLookup) {
+  std::unordered_map<int, std::string> table;
+  for (int i = 0; i < 1000; i += 2) {
+    table[i] = std::to_string(i);
+  }
+  std::vector<int> keys;
+  for (int i = 0; i < 100; ++i) {
+    keys.push_back(i * 7);
+  }
+  auto found = keys | lookup(table, 8);
+  ASSERT_EQ(found.size(), keys.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    EXPECT_EQ(found[i], keys[i] % 2 == 0 ? std::optional<std::string>(std::to_string(keys[i])) : std::nullopt);
+  }
+  std::map<int, std::string> ordered(table.begin(), table.end());
+  EXPECT_EQ(keys | lookup(ordered), found);
+  std::unordered_map<int, std::string> empty;
+  EXPECT_EQ((std::vector<int>{1, 2} | lookup(empty)), (std::vector<std::optional<std::string>>(2)));
+  auto hits = keys | (lookup(table) | Filter([](const auto& value) { return value.has_value(); }) | Take(2));
+  EXPECT_EQ(hits, (std::vector<std::optional<std::string>>{"0", "14"}));
+}
+
+TEST(ScanTest, InclusiveAndExclusive) {
+  std::vector<int> lengths = {3, 1, 4, 1, 5};
+  EXPECT_EQ(lengths | inclusive_scan(), (std::vector<int>{3, 4, 8, 9, 14}));
+  EXPECT_EQ(lengths | exclusive_scan(size_t(0)), (std::vector<size_t>{0, 3, 4, 8, 9}));
+  EXPECT_EQ(lengths | inclusive_scan([](int lhs, int rhs) { return std::max(lhs, rhs); }),
+            (std::vector<int>{3, 3, 4, 4, 5}));
+  EXPECT_EQ(lengths | exclusive_scan(1, std::multiplies<>()), (std::vector<int>{1, 3, 3, 12, 12}));
+  EXPECT_TRUE((std::vector<int>{} | inclusive_scan()).empty());
+  std::list<int> list(lengths.begin(), lengths.end());
+  EXPECT_EQ(list | inclusive_scan(), (std::vector<int>{3, 4, 8, 9, 14}));
+}
+
+TEST(ScanTest, ParallelMatchesSerial) {
+  std::vector<uint32_t> lengths(1000003);
+  std::mt19937 rng(5);
+  for (auto& length : lengths) {
+    length = rng() % 100;
+  }
+  std::vector<uint32_t> inclusive(lengths.size());
+  std::inclusive_scan(lengths.begin(), lengths.end(), inclusive.begin());
+  std::vector<uint64_t> offsets(lengths.size());
+  std::exclusive_scan(lengths.begin(), lengths.end(), offsets.begin(), uint64_t(7));
+  for (size_t threads : {1, 3, 8}) {
+    EXPECT_EQ(lengths | inclusive_scan().with_threads(threads), inclusive);
+    EXPECT_EQ(lengths | exclusive_scan(uint64_t(7)).with_threads(threads), offsets);
+  }
+  auto throwing = [](uint32_t lhs, uint32_t rhs) -> uint32_t {
+    if (rhs == 99) throw std::runtime_error("bad length");
+
+    return lhs + rhs;
+  };
+  EXPECT_THROW((lengths | inclusive_scan(throwing).with_threads(4)).value(), std::runtime_error);
+
+  // Префикс конкатенации ассоциативен, но не коммутативен
+  std::vector<std::string> letters(200000);
+  for (size_t i = 0; i < letters.size(); ++i) {
+    letters[i] = std::string(1, static_cast<char>('a' + i % 26));
+  }
+  auto concat = [](const std::string& lhs, const std::string& rhs) { return (lhs + rhs).substr(0, 8); };
+  auto scanned = letters | inclusive_scan(concat).with_threads(4);
+  EXPECT_EQ(scanned, letters | inclusive_scan(concat).with_threads(1));
+  EXPECT_EQ(scanned.back(), "abcdefgh");
+}
+
+TEST(ScanTest, StreamingScanAndEnumerate) {
+  std::vector<int> vec = {5, -2, 7, 0, 3};
+  EXPECT_EQ(vec | (Filter([](int x) { return x > 0; }) | inclusive_scan()), (std::vector<int>{5, 12, 15}));
+  EXPECT_EQ(vec | (exclusive_scan(0) | Take(3)), (std::vector<int>{0, 5, 3}));
+
+  std::vector<std::string> words = {"a", "bb", "ccc"};
+  std::vector<std::pair<size_t, std::string>> pairs;
+  for (auto [index, word] : words | enumerate()) {
+    EXPECT_EQ(&word, &words[index]);
+    pairs.emplace_back(index, word);
+  }
+  EXPECT_EQ(pairs, (std::vector<std::pair<size_t, std::string>>{{0, "a"}, {1, "bb"}, {2, "ccc"}}));
+  EXPECT_EQ((words | enumerate()).size(), 3u);
+  auto long_positions = words | (enumerate() | Filter([](const auto& p) { return p.second.size() > 1; })
+                                 | Transform([](const auto& p) { return p.first; }));
+  EXPECT_EQ(long_positions, (std::vector<size_t>{1, 2}));
+}
+
+TEST(ScanTest, EnumerateTemporaryInput) {
+  std::vector<int> vec = {5, -2, 7, 0, 3};
+  auto positives = vec | Filter([](int x) { return x > 0; }) | enumerate();
+  EXPECT_EQ(positives, (std::vector<std::pair<size_t, int>>{{0, 5}, {1, 7}, {2, 3}}));
+  auto words = std::vector<std::string>{"x", "yy"} | enumerate();
+  EXPECT_EQ(words, (std::vector<std::pair<size_t, std::string>>{{0, "x"}, {1, "yy"}}));
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+// Агрегаты одного временного окна [start, end)
+template<typename Timestamp, typename Value>
+struct WindowStats {
+  Timestamp start;
+  Timestamp end;
+  size_t count;
+  Value sum;
+  Value min;
+  Value max;
+
+  bool operator==(const WindowStats&) const = default;
+};
+
+// Очередь значений скользящего окна с агрегатами за O(1) амортизированно.
+// Минимум и максимум хранятся монотонными деками, сумма - в двух стеках:
+// при извлечении сумма не вычитается, поэтому для чисел с плавающей точкой
+// ошибка не накапливается.
+template<typename Timestamp, typename Value>
+class WindowAggregator {
+ public:
+  void push(Timestamp ts, const Value& value) {
+    back.push_back({ts, value, Value()});
+    back_sum = back.size() == 1 ? value : back_sum + value;
+    while (!maxima.empty() && !(value < maxima.back().value)) {
+      maxima.pop_back();
+    }
+    maxima.push_back({pushed, value});
+    while (!minima.empty() && !(minima.back().value < value)) {
+      minima.pop_back();
+    }
+    minima.push_back({pushed, value});
+    ++pushed;
+  }
+
+  // Удаляет значения с меткой раньше ts
+  void evict_before(Timestamp ts) {
+    while (!empty() && oldest() < ts) {
+      pop();
+    }
+  }
+
+  bool empty() const {
+
+    return front.empty() && back.empty();
+  }
+
+  size_t count() const {
+
+    return front.size() + back.size();
+  }
+
+  Timestamp oldest() const {
+
+    return front.empty() ? back.front().ts : front.back().ts;
+  }
+
+  Value sum() const {
+    if (front.empty()) return back_sum;
+    if (back.empty()) return front.back().sum;
+
+    return front.back().sum + back_sum;
+  }
+
+  Value min() const {
+
+    return minima.front().value;
+  }
+
+  Value max() const {
+
+    return maxima.front().value;
+  }
+
+ private:
+  struct Entry {
+    Timestamp ts;
+    Value value;
+    // Во фронтальном стеке - сумма этого элемента и всех, что лежат под ним
+    Value sum;
+  };
+
+  struct Candidate {
+    size_t seq;
+    Value value;
+  };
+
+  void pop() {
+    if (front.empty()) {
+      // Перекладываем с конца, чтобы старейший элемент оказался на вершине
+      for (size_t i = back.size(); i-- > 0;) {
+        Value sum = front.empty() ? back[i].value : back[i].value + front.back().sum;
+        front.push_back({back[i].ts, back[i].value, sum});
+      }
+      back.clear();
+    }
+    front.pop_back();
+    if (maxima.front().seq == popped) {
+      maxima.pop_front();
+    }
+    if (minima.front().seq == popped) {
+      minima.pop_front();
+    }
+    ++popped;
+  }
+
+  std::vector<Entry> front;
+  std::vector<Entry> back;
+  Value back_sum = Value();
+  std::deque<Candidate> maxima;
+  std::deque<Candidate> minima;
+  size_t pushed = 0;
+  size_t popped = 0;
+};